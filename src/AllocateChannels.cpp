@@ -27,6 +27,7 @@
 #include "MidiDevice.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace Rosegarden {
 
@@ -231,6 +232,110 @@ ChannelInterval FreeChannels::allocateChannelIntervalFrom(
                           RealTime::zeroTime );
 }
 
+namespace {
+
+// Orders requests by the time they need their channel from.
+struct RequestStartCmp {
+  bool operator()( const ChannelIntervalRequest *a,
+                   const ChannelIntervalRequest *b ) const {
+    if( a->m_start != b->m_start ) return a->m_start < b->m_start;
+    return a->m_end < b->m_end;
+  }
+};
+
+} // namespace
+
+// Allocate channel intervals for all of requests in one sweep.
+void FreeChannels::allocateAll( ChannelIntervalRequests &requests ) {
+  // Only the channels nothing holds any of are ours to share out.
+  // The pieces of the others stay as they are.
+  std::vector<ChannelId> channels;
+  container              pieces;
+  for( iterator i = begin(); i != end(); ++i ) {
+    if( i->m_start == ChannelInterval::m_beforeEarliestTime &&
+        i->m_end == ChannelInterval::m_afterLatestTime )
+      channels.push_back( i->getChannelId() );
+    else
+      pieces.insert( pieces.end(), *i );
+  }
+  std::sort( channels.begin(), channels.end() );
+
+  // Where each channel is up to: the end of the interval last
+  // allocated on it and who that was for.
+  struct ChannelState {
+    ChannelId   channel;
+    RealTime    end;
+    Instrument *instrument;
+    RealTime    marginAfter;
+  };
+  std::vector<ChannelState> states;
+  for( size_t c = 0; c < channels.size(); ++c ) {
+    ChannelState state = { channels[c],
+                           ChannelInterval::m_beforeEarliestTime,
+                           nullptr, RealTime::zeroTime };
+    states.push_back( state );
+  }
+
+  std::vector<ChannelIntervalRequest *> sorted;
+  for( size_t i = 0; i < requests.size(); ++i )
+    sorted.push_back( &requests[i] );
+  std::stable_sort( sorted.begin(), sorted.end(),
+                    RequestStartCmp() );
+
+  for( size_t i = 0; i < sorted.size(); ++i ) {
+    ChannelIntervalRequest &r = *sorted[i];
+
+    // The same tests allocateChannelInterval() makes of a free
+    // piece, and the same best fit: the piece that starts latest
+    // is the smallest.  Of equals, rather keep the instrument.
+    ChannelState *best = nullptr;
+    for( size_t c = 0; c < states.size(); ++c ) {
+      ChannelState &state = states[c];
+      if( state.end > r.m_start ) continue;
+      if( state.instrument && state.instrument != r.m_instrument &&
+          ( state.end + r.m_marginBefore > r.m_start ||
+            state.end + state.marginAfter > r.m_start ) )
+        continue;
+      if( !best || state.end > best->end ||
+          ( state.end == best->end &&
+            state.instrument == r.m_instrument &&
+            best->instrument != r.m_instrument ) )
+        best = &state;
+    }
+
+    if( !best ) {
+      *r.m_channelInterval = ChannelInterval();
+      continue;
+    }
+
+    // The free piece this leaves before the new interval.
+    if( best->end < r.m_start )
+      pieces.insert( ChannelInterval(
+          best->channel, best->end, r.m_start, best->instrument,
+          r.m_instrument, best->marginAfter, r.m_marginBefore ) );
+
+    *r.m_channelInterval = ChannelInterval(
+        best->channel, r.m_start, r.m_end, nullptr, nullptr,
+        RealTime::zeroTime, RealTime::zeroTime );
+
+    best->end         = r.m_end;
+    best->instrument  = r.m_instrument;
+    best->marginAfter = r.m_marginAfter;
+  }
+
+  // And what is left after the last.
+  for( size_t c = 0; c < states.size(); ++c ) {
+    const ChannelState &state = states[c];
+    if( state.end < ChannelInterval::m_afterLatestTime )
+      pieces.insert( ChannelInterval(
+          state.channel, state.end,
+          ChannelInterval::m_afterLatestTime, state.instrument,
+          nullptr, state.marginAfter, RealTime::zeroTime ) );
+  }
+
+  swap( pieces );
+}
+
 // Add a channel that may be allocated from.  It is caller's
 // responsibility to not duplicate channel numbers.
 // @author Tom Breton (Tehom)
@@ -355,6 +460,27 @@ void AllocateChannels::freeChannelInterval(
   }
 }
 
+// Re-allocate the channel intervals of requests all together.
+void AllocateChannels::allocateAll(
+    ChannelIntervalRequests &requests ) {
+  ChannelIntervalRequests normal;
+  for( size_t i = 0; i < requests.size(); ++i ) {
+    ChannelIntervalRequest &r = requests[i];
+    if( r.m_channelInterval->validChannel() )
+      freeChannelInterval( *r.m_channelInterval );
+
+    if( r.m_instrument->isPercussion() ) {
+      *r.m_channelInterval = ChannelInterval(
+          getPercussionChannel(), r.m_start, r.m_end, nullptr,
+          nullptr, RealTime::zeroTime, RealTime::zeroTime );
+    } else {
+      normal.push_back( r );
+    }
+  }
+
+  m_freeChannels.allocateAll( normal );
+}
+
 // Reserve a channel for a fixed-channel instrument.
 // The signal connections this uses are made by ChannelManager.
 // @author Tom Breton (Tehom)
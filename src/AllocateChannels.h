@@ -23,12 +23,29 @@
 
 #include <set>
 #include <list>
+#include <vector>
 
 namespace Rosegarden
 {
 
 class Instrument;
 
+/// A channel interval wanted, for allocating in a batch.
+/**
+ * @see FreeChannels::allocateAll()
+ */
+struct ChannelIntervalRequest
+{
+    // Where the channel interval allocated goes
+    ChannelInterval *m_channelInterval;
+    Instrument *m_instrument;
+    RealTime m_start;
+    RealTime m_end;
+    RealTime m_marginBefore;
+    RealTime m_marginAfter;
+};
+typedef std::vector<ChannelIntervalRequest> ChannelIntervalRequests;
+
 /// A set of currently free channel intervals.
 /**
  * Does not concern itself with Device or Instrument.
@@ -60,6 +77,13 @@ public:
     // Free a channel interval
     void freeChannelInterval(ChannelInterval &old);
 
+    // Allocate channel intervals for all of requests together, on the
+    // channels that are wholly free.  Sweeps the requests in order of
+    // start time, giving each the channel that has been free for the
+    // shortest time that it fits on, so the result depends only on
+    // the requests and not on the order they come in, except for
+    // ties.  Requests that fit nowhere get an invalid interval.
+    void allocateAll(ChannelIntervalRequests &requests);
   
     // Make it so that "channelNb" can be allocated from.
     void addChannel(ChannelId channelNb);
@@ -119,6 +143,10 @@ public:
 
     void freeChannelInterval(ChannelInterval &old);
 
+    // Free the channel intervals of requests, then allocate them all
+    // afresh together.  See FreeChannels::allocateAll().
+    void allocateAll(ChannelIntervalRequests &requests);
+
     void reserveFixedChannel(ChannelId channel);
     void releaseFixedChannel(ChannelId channel)
         { releaseReservedChannel(channel, m_fixedChannels); }
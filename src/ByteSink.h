@@ -0,0 +1,67 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_BYTE_SINK_H
+#define RG_BYTE_SINK_H
+
+#include <cstddef>
+#include <ostream>
+
+namespace Rosegarden
+{
+
+/// Somewhere for MidiFile to write a Standard MIDI File.
+/**
+ * MidiFile writes each chunk in a few calls to write(), in file order,
+ * and calls flush() once at the end, so a sink can pass the bytes on
+ * to a pipe, a compressor or a socket as they come without ever
+ * seeking.
+ */
+class ByteSink
+{
+public:
+    virtual ~ByteSink() { }
+
+    virtual void write(const char *data, size_t length) = 0;
+
+    /// Push out what has been written.
+    /**
+     * Returns false if any of it, from the first write() on, failed to
+     * get out.
+     */
+    virtual bool flush() = 0;
+};
+
+/// A ByteSink writing to a std::ostream, eg a file or std::cout.
+/**
+ * The stream should be in binary mode.  It is not owned.
+ */
+class StreamByteSink : public ByteSink
+{
+public:
+    explicit StreamByteSink(std::ostream &stream) : m_stream(stream) { }
+
+    void write(const char *data, size_t length) override
+        { m_stream.write(data, length); }
+    bool flush() override
+        { return m_stream.flush().good(); }
+
+private:
+    std::ostream &m_stream;
+};
+
+}
+
+#endif
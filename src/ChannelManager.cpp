@@ -30,6 +30,8 @@
 #include "MappedInserterBase.h"
 #include "Midi.h"
 
+#include <map>
+
 namespace Rosegarden {
 
 ChannelManager::ChannelManager( Instrument *instrument )
@@ -41,6 +43,8 @@ ChannelManager::ChannelManager( Instrument *instrument )
     m_channelInterval(),
     m_usingAllocator( false ),
     m_triedToGetChannel( false ),
+    m_allocationDeferred( false ),
+    m_allocationPending( false ),
     m_ready( false ) {
   // Safe even for nullptr.
   connectInstrument( instrument );
@@ -368,7 +372,10 @@ void ChannelManager::allocateChannelInterval(
   // allocator") << "for" << (void *)m_instrument;
 
   if( m_instrument ) {
-    if( m_usingAllocator ) {
+    if( m_usingAllocator && m_allocationDeferred ) {
+      // allocateChannelIntervals() will get it.
+      m_allocationPending = true;
+    } else if( m_usingAllocator ) {
       // Only Midi instruments should have m_usingAllocator set.
 
       getAllocator()->reallocateToFit(
@@ -388,6 +395,8 @@ void ChannelManager::allocateChannelInterval(
 }
 
 void ChannelManager::freeChannelInterval() {
+  m_allocationPending = false;
+
   if( m_instrument && m_usingAllocator ) {
     AllocateChannels *allocator = getAllocator();
 
@@ -400,6 +409,41 @@ void ChannelManager::freeChannelInterval() {
   }
 }
 
+void ChannelManager::allocateChannelIntervals(
+    const std::vector<ChannelManager *> &managers ) {
+  typedef std::map<AllocateChannels *, ChannelIntervalRequests>
+                                 RequestsByAllocator;
+  RequestsByAllocator            requests;
+  std::vector<ChannelManager *> allocated;
+
+  for( size_t i = 0; i < managers.size(); ++i ) {
+    ChannelManager *m = managers[i];
+    bool            pending = m->m_allocationPending;
+    m->m_allocationDeferred = false;
+    m->m_allocationPending  = false;
+    if( !pending || !m->m_instrument || !m->m_usingAllocator )
+      continue;
+    AllocateChannels *allocator = m->getAllocator();
+    if( !allocator ) continue;
+
+    ChannelIntervalRequest request = {
+        &m->m_channelInterval, m->m_instrument, m->m_start,
+        m->m_end, m->m_startMargin, m->m_endMargin };
+    requests[allocator].push_back( request );
+    allocated.push_back( m );
+  }
+
+  for( RequestsByAllocator::iterator i = requests.begin();
+       i != requests.end(); ++i )
+    i->first->allocateAll( i->second );
+
+  // The channel may have changed, so setup must go out again.
+  for( size_t i = 0; i < allocated.size(); ++i ) {
+    allocated[i]->connectAllocator();
+    allocated[i]->m_ready = false;
+  }
+}
+
 void ChannelManager::setInstrument( Instrument *instrument ) {
   // RG_DEBUG << "setInstrument(): Setting instrument to" <<
   // (void *)instrument << "It was" << (void *)m_instrument;
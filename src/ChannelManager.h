@@ -21,6 +21,8 @@
 #include "RealTime.h"
 #include "Track.h"  // For TrackId
 
+#include <vector>
+
 namespace Rosegarden
 {
 
@@ -140,6 +142,27 @@ public:
      */
     void freeChannelInterval();
 
+    /// Have allocateChannelInterval() only note that one is wanted.
+    /**
+     * Until allocateChannelIntervals() is called with this
+     * ChannelManager, which also ends the deferral.
+     */
+    void deferAllocation()  { m_allocationDeferred = true; }
+
+    /// Allocate ChannelIntervals for many ChannelManagers together.
+    /**
+     * Each ChannelManager otherwise gets its ChannelInterval as soon as
+     * its Segment is mapped, so which channel it gets depends on the
+     * order the Segments were mapped in.  This allocates all those that
+     * deferred allocation and have since wanted one from an allocator,
+     * all at once from their required intervals.  Those that haven't,
+     * e.g. because their track is muted, are left alone.
+     *
+     * @see deferAllocation() and AllocateChannels::allocateAll()
+     */
+    static void allocateChannelIntervals(
+            const std::vector<ChannelManager *> &managers);
+
     // *** Channel Setup
 
     // ??? Why are there all of these variations?  Can we somehow simplify
@@ -314,6 +337,15 @@ private:
      */
     bool m_triedToGetChannel;
 
+    /// Whether allocateChannelInterval() is to leave it to later.
+    /**
+     * @see deferAllocation()
+     */
+    bool m_allocationDeferred;
+
+    /// Whether allocateChannelInterval() was called while deferred.
+    bool m_allocationPending;
+
     /// Get the channel allocator from the Instrument's Device.
     AllocateChannels *getAllocator();
 
@@ -25,6 +25,7 @@
 #include "Profiler.h"
 #include "Segment.h"
 #include "SegmentLinker.h"
+#include "SegmentPerformanceHelper.h"
 
 #include <limits.h>
 #include <algorithm>
@@ -181,7 +182,8 @@ Composition::Composition()
     m_loopEnd( 0 ),
     m_playMetronome( false ),
     m_recordMetronome( true ),
-    m_nextTriggerSegmentId( 0 ) {
+    m_nextTriggerSegmentId( 0 ),
+    m_frozen( false ) {
   // nothing else
 }
 
@@ -403,9 +405,16 @@ int Composition::getMaxContemporaneousSegmentsOnTrack(
   Profiler profiler(
       "Composition::getMaxContemporaneousSegmentsOnTrack" );
 
-  if( m_trackVoiceCountCache.empty() ) { rebuildVoiceCaches(); }
+  // A frozen Composition built its caches in freeze().
+  if( !m_frozen && m_trackVoiceCountCache.empty() ) {
+    rebuildVoiceCaches();
+  }
 
-  int count = m_trackVoiceCountCache[track];
+  // Look up without inserting, since tracks without segments
+  // aren't in the cache.
+  std::map<TrackId, int>::const_iterator i =
+      m_trackVoiceCountCache.find( track );
+  int count = i == m_trackVoiceCountCache.end() ? 0 : i->second;
   //    std::cerr << "max contemporaneous on track " << track <<
   //    " = " << count << std::endl;
   return count;
@@ -413,11 +422,13 @@ int Composition::getMaxContemporaneousSegmentsOnTrack(
 
 int Composition::getSegmentVoiceIndex(
     const Segment *segment ) const {
-  if( m_segmentVoiceIndexCache.empty() ) {
+  if( !m_frozen && m_segmentVoiceIndexCache.empty() ) {
     rebuildVoiceCaches();
   }
 
-  return m_segmentVoiceIndexCache[segment];
+  std::map<const Segment*, int>::const_iterator i =
+      m_segmentVoiceIndexCache.find( segment );
+  return i == m_segmentVoiceIndexCache.end() ? 0 : i->second;
 }
 
 void Composition::resetLinkedSegmentRefreshStatuses() {
@@ -600,9 +611,40 @@ void Composition::clear() {
   m_startMarker     = 0;
   m_endMarker       = getBarRange( m_defaultNbBars ).first;
   m_selectedTrackId = 0;
+  m_frozen          = false;
   updateRefreshStatuses();
 }
 
+void Composition::freeze() {
+  if( m_frozen ) return;
+
+  calculateBarPositions();
+  calculateTempoTimestamps();
+  rebuildVoiceCaches();
+
+  // Let the performance helper make its fix-ups now, once, so that
+  // it need not write to any Event later.
+  std::vector<Segment *> segments( m_segments.begin(),
+                                   m_segments.end() );
+  for( triggersegmentcontaineriterator i = m_triggerSegments.begin();
+       i != m_triggerSegments.end(); ++i ) {
+    if( ( *i )->getSegment() )
+      segments.push_back( ( *i )->getSegment() );
+  }
+
+  for( std::vector<Segment *>::iterator s = segments.begin();
+       s != segments.end(); ++s ) {
+    SegmentPerformanceHelper helper( **s );
+    for( Segment::iterator i = ( *s )->begin(); i != ( *s )->end();
+         ++i ) {
+      if( ( *i )->isa( Note::EventType ) )
+        helper.getSoundingDuration( i );
+    }
+  }
+
+  m_frozen = true;
+}
+
 void Composition::calculateBarPositions() const {
   if( !m_barPositionsNeedCalculating ) return;
 
@@ -763,6 +763,24 @@ public:
     // OTHER STUFF
 
 
+    /**
+     * Turn the Composition into a read-only snapshot.  Everything the
+     * read paths would otherwise compute or fix up lazily (bar
+     * positions, tempo timestamps, segment voice caches, dangling
+     * ties, grace note host flags) is settled here, and from then on
+     * no const or performance-helper query writes to the Composition,
+     * its Segments or their Events.  The only writes left are
+     * Segment::addObserver() and removeObserver(), which are locked,
+     * so a frozen Composition may be read from several threads at
+     * once.
+     *
+     * The caller promises not to modify the Composition while it is
+     * frozen; call thaw() first.
+     */
+    void freeze();
+    void thaw() { m_frozen = false; }
+    bool isFrozen() const { return m_frozen; }
+
     // Some set<> API delegation
     /// Segment begin iterator.
     iterator       begin()       { return m_segments.begin(); }
@@ -1079,6 +1097,8 @@ protected:
     //
     mutable std::map<TrackId, int>    m_trackVoiceCountCache;
     mutable std::map<const Segment *, int>  m_segmentVoiceIndexCache;
+
+    bool                              m_frozen;
 };
 
 
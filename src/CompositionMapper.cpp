@@ -20,16 +20,32 @@
 
 #include "CompositionMapper.h"
 
+#include "ChannelManager.h"
 #include "Composition.h"
+#include "LinkedSegmentMapping.h"
 #include "MappedEventBuffer.h"
 #include "RosegardenDocument.h"
 #include "Segment.h"
 #include "SegmentMapper.h"
 
+#include <limits>
+#include <vector>
+
 namespace Rosegarden {
 
 CompositionMapper::CompositionMapper( RosegardenDocument *doc )
-  : m_doc( doc ) {
+  : CompositionMapper( doc, std::numeric_limits<timeT>::min(),
+                       std::numeric_limits<timeT>::max(),
+                       std::set<TrackId>() ) {}
+
+CompositionMapper::CompositionMapper(
+    RosegardenDocument *doc, timeT startTime, timeT endTime,
+    const std::set<TrackId> &tracks )
+  : m_doc( doc ),
+    m_startTime( startTime ),
+    m_endTime( endTime ),
+    m_tracks( tracks ),
+    m_linkedMappings( new LinkedSegmentMappings ) {
   Composition &comp = m_doc->getComposition();
 
   for( Composition::iterator it = comp.begin(); it != comp.end();
@@ -40,8 +56,24 @@ CompositionMapper::CompositionMapper( RosegardenDocument *doc )
     //
     if( track == nullptr ) continue;
 
-    mapSegment( *it );
+    if( !isWanted( *it ) ) continue;
+
+    mapSegment( *it, true );
+  }
+
+  // Each mapper only noted the channel it wanted as it mapped.  Now
+  // that we know all the intervals, share the channels out together.
+  std::vector<ChannelManager *> channelManagers;
+  for( Composition::iterator it = comp.begin(); it != comp.end();
+       ++it ) {
+    SegmentMappers::iterator found = m_segmentMappers.find( *it );
+    if( found == m_segmentMappers.end() || !found->second )
+      continue;
+    ChannelManager *channelManager =
+        found->second->getChannelManager();
+    if( channelManager ) channelManagers.push_back( channelManager );
   }
+  ChannelManager::allocateChannelIntervals( channelManagers );
 }
 
 CompositionMapper::~CompositionMapper() {}
@@ -65,7 +97,7 @@ bool CompositionMapper::segmentModified( Segment *segment ) {
 }
 
 void CompositionMapper::segmentAdded( Segment *segment ) {
-  mapSegment( segment );
+  if( isWanted( segment ) ) mapSegment( segment );
 }
 
 void CompositionMapper::segmentDeleted( Segment *segment ) {
@@ -93,7 +125,8 @@ void CompositionMapper::segmentDeleted( Segment *segment ) {
   // code at your own risk.
 }
 
-void CompositionMapper::mapSegment( Segment *segment ) {
+void CompositionMapper::mapSegment( Segment *segment,
+                                    bool     deferChannelAllocation ) {
   SegmentMappers::iterator itMapper =
       m_segmentMappers.find( segment );
 
@@ -103,11 +136,23 @@ void CompositionMapper::mapSegment( Segment *segment ) {
     return;
   }
   std::shared_ptr<SegmentMapper> mapper =
-      SegmentMapper::makeMapperForSegment( m_doc, segment );
+      SegmentMapper::makeMapperForSegment(
+          m_doc, segment, m_linkedMappings, deferChannelAllocation );
 
   if( mapper ) { m_segmentMappers[segment] = mapper; }
 }
 
+bool CompositionMapper::isWanted( const Segment *segment ) const {
+  if( !m_tracks.empty() &&
+      m_tracks.find( segment->getTrack() ) == m_tracks.end() )
+    return false;
+
+  // Repeats count; the delay moves the whole Segment.
+  timeT delay = segment->getDelay();
+  return segment->getStartTime() + delay < m_endTime &&
+         segment->getRepeatEndTime() + delay > m_startTime;
+}
+
 std::shared_ptr<MappedEventBuffer>
 CompositionMapper::getMappedEventBuffer( Segment *s ) {
   // !!! WARNING !!!
@@ -18,12 +18,17 @@
 #ifndef RG_COMPOSITIONMAPPER_H
 #define RG_COMPOSITIONMAPPER_H
 
+#include "Event.h"
+#include "Track.h"
+
 #include <map>
 #include <memory>
+#include <set>
 
 namespace Rosegarden
 {
 
+class LinkedSegmentMappings;
 class SegmentMapper;
 class MappedEventBuffer;
 class Segment;
@@ -42,6 +47,14 @@ class CompositionMapper
 {
 public:
     CompositionMapper(RosegardenDocument *doc);
+    /// Map only the Segments that play between startTime and endTime.
+    /**
+     * And of those only the ones on tracks, unless tracks is empty.
+     * Segments added later are filtered the same way.
+     */
+    CompositionMapper(RosegardenDocument *doc,
+                      timeT startTime, timeT endTime,
+                      const std::set<TrackId> &tracks);
     ~CompositionMapper();
 
     /// Get the SegmentMapper for a Segment
@@ -67,11 +80,25 @@ public:
 
 private:
     /// Creates a SegmentMapper and adds it to the container.
-    void mapSegment(Segment *);
+    /**
+     * If deferChannelAllocation, the mapper leaves getting a channel to
+     * ChannelManager::allocateChannelIntervals().
+     */
+    void mapSegment(Segment *, bool deferChannelAllocation = false);
+
+    /// Whether the Segment is on a wanted track and plays in the range.
+    bool isWanted(const Segment *) const;
 
     /// Passed to the SegmentMapper objects that are created.
     RosegardenDocument *m_doc;
 
+    timeT m_startTime;
+    timeT m_endTime;
+    std::set<TrackId> m_tracks;
+
+    /// Mappings shared by linked Segments, for the mappers.
+    std::shared_ptr<LinkedSegmentMappings> m_linkedMappings;
+
 };
 
 
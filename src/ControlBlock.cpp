@@ -17,6 +17,7 @@
 
 #define RG_MODULE_STRING "[ControlBlock]"
 
+#include <algorithm>
 #include <cstring>
 
 #include "ControlBlock.h"
@@ -55,7 +56,6 @@ ControlBlock *ControlBlock::getInstance() {
 
 ControlBlock::ControlBlock()
   : m_doc( nullptr ),
-    m_maxTrackId( 0 ),
     m_thruFilter( 0 ),
     m_recordFilter( 0 ),
     m_selectedTrack( 0 ) {
@@ -65,23 +65,32 @@ ControlBlock::ControlBlock()
   setSelectedTrack( 0 );
 }
 
-void ControlBlock::clearTracks() {
-  // ??? Giving TrackInfo a proper default ctor would simplify
-  // this.
-  //       m_trackInfo[i] = TrackInfo();
-  //     It would also mean that this wouldn't need to be called
-  //     in the ctor.
+void ControlBlock::clearTracks() { m_trackInfo.clear(); }
 
-  for( unsigned int i = 0; i < CONTROLBLOCK_MAX_NB_TRACKS; ++i )
-    m_trackInfo[i].clear();
+TrackInfo *ControlBlock::makeTrackInfo( TrackId trackId ) {
+  if( trackId == NO_TRACK ) return nullptr;
+  if( trackId >= CONTROLBLOCK_MAX_NB_TRACKS ) return nullptr;
+
+  if( trackId >= m_trackInfo.size() ) {
+    size_t oldSize = m_trackInfo.size();
+    m_trackInfo.resize( trackId + 1 );
+    // ??? Giving TrackInfo a proper default ctor would make
+    //     this unnecessary.
+    for( size_t i = oldSize; i < m_trackInfo.size(); ++i )
+      m_trackInfo[i].clear();
+  }
+  return &m_trackInfo[trackId];
 }
 
 void ControlBlock::setDocument( RosegardenDocument *doc ) {
   clearTracks();
-  m_doc        = doc;
-  m_maxTrackId = m_doc->getComposition().getMaxTrackId();
+  m_doc = doc;
 
   Composition &comp = m_doc->getComposition();
+  if( !comp.getTracks().empty() )
+    m_trackInfo.reserve(
+        std::min<size_t>( comp.getMaxTrackId() + 1,
+                          CONTROLBLOCK_MAX_NB_TRACKS ) );
 
   for( Composition::trackiterator i = comp.getTracks().begin();
        i != comp.getTracks().end(); ++i ) {
@@ -109,66 +118,67 @@ void ControlBlock::updateTrackData( Track *t ) {
     setTrackChannelFilter( t->getId(),
                            t->getMidiInputChannel() );
     setTrackThruRouting( t->getId(), t->getThruRouting() );
-    if( t->getId() > m_maxTrackId ) m_maxTrackId = t->getId();
   }
 }
 
 void ControlBlock::setInstrumentForTrack( TrackId      trackId,
                                           InstrumentId instId ) {
-  if( trackId >= CONTROLBLOCK_MAX_NB_TRACKS ) { return; }
-  TrackInfo &track = m_trackInfo[trackId];
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( !track ) return;
 
-  track.releaseThruChannel( m_doc->getStudio() );
-  track.m_instrumentId = instId;
-  track.conform( m_doc->getStudio() );
+  track->releaseThruChannel( m_doc->getStudio() );
+  track->m_instrumentId = instId;
+  track->conform( m_doc->getStudio() );
 }
 
 InstrumentId ControlBlock::getInstrumentForTrack(
     TrackId trackId ) const {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    return m_trackInfo[trackId].m_instrumentId;
+  const TrackInfo *track = findTrackInfo( trackId );
+  if( track ) return track->m_instrumentId;
   return 0;
 }
 
 void ControlBlock::setTrackMuted( TrackId trackId, bool mute ) {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    m_trackInfo[trackId].m_muted = mute;
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( track ) track->m_muted = mute;
 }
 
 bool ControlBlock::isTrackMuted( TrackId trackId ) const {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    return m_trackInfo[trackId].m_muted;
+  const TrackInfo *track = findTrackInfo( trackId );
+  if( track ) return track->m_muted;
   return true;
 }
 
 void ControlBlock::setTrackArchived( TrackId trackId,
                                      bool    archived ) {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    m_trackInfo[trackId].m_archived = archived;
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( track ) track->m_archived = archived;
 }
 
 bool ControlBlock::isTrackArchived( TrackId trackId ) const {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    return m_trackInfo[trackId].m_archived;
+  const TrackInfo *track = findTrackInfo( trackId );
+  if( track ) return track->m_archived;
   return true;
 }
 
 void ControlBlock::setSolo( TrackId trackId, bool solo ) {
+  TrackInfo *track = makeTrackInfo( trackId );
   // Bail on invalid track ID.
-  if( trackId >= CONTROLBLOCK_MAX_NB_TRACKS ) return;
+  if( !track ) return;
 
-  m_trackInfo[trackId].m_solo = solo;
+  track->m_solo = solo;
 }
 
 bool ControlBlock::isSolo( TrackId trackId ) const {
-  if( trackId >= CONTROLBLOCK_MAX_NB_TRACKS ) return false;
+  const TrackInfo *track = findTrackInfo( trackId );
+  if( !track ) return false;
 
-  return m_trackInfo[trackId].m_solo;
+  return track->m_solo;
 }
 
 bool ControlBlock::isAnyTrackInSolo() const {
   // For each track
-  for( unsigned int i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     const TrackInfo &track = m_trackInfo[i];
 
     // If this track was deleted, try the next.
@@ -181,18 +191,18 @@ bool ControlBlock::isAnyTrackInSolo() const {
 }
 
 void ControlBlock::setTrackArmed( TrackId trackId, bool armed ) {
-  if( trackId >= CONTROLBLOCK_MAX_NB_TRACKS ) { return; }
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( !track ) return;
 
-  TrackInfo &track = m_trackInfo[trackId];
-  track.m_armed    = armed;
-  track.conform( m_doc->getStudio() );
+  track->m_armed = armed;
+  track->conform( m_doc->getStudio() );
 }
 
 #if 0
 bool 
 ControlBlock::isTrackArmed(TrackId trackId) const
 {
-    if (trackId < CONTROLBLOCK_MAX_NB_TRACKS)
+    if (trackId < m_trackInfo.size())
         return m_trackInfo[trackId].m_armed;
     return false;
 }
@@ -200,18 +210,18 @@ ControlBlock::isTrackArmed(TrackId trackId) const
 
 void ControlBlock::setTrackDeleted( TrackId trackId,
                                     bool    deleted ) {
-  if( trackId >= CONTROLBLOCK_MAX_NB_TRACKS ) { return; }
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( !track ) return;
 
-  TrackInfo &track = m_trackInfo[trackId];
-  track.m_deleted  = deleted;
-  track.conform( m_doc->getStudio() );
+  track->m_deleted = deleted;
+  track->conform( m_doc->getStudio() );
 }
 
 #if 0
 bool 
 ControlBlock::isTrackDeleted(TrackId trackId) const
 {
-    if (trackId < CONTROLBLOCK_MAX_NB_TRACKS)
+    if (trackId < m_trackInfo.size())
         return m_trackInfo[trackId].m_deleted;
     return true;
 }
@@ -219,15 +229,15 @@ ControlBlock::isTrackDeleted(TrackId trackId) const
 
 void ControlBlock::setTrackChannelFilter( TrackId trackId,
                                           char    channel ) {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    m_trackInfo[trackId].m_channelFilter = channel;
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( track ) track->m_channelFilter = channel;
 }
 
 #if 0
 char
 ControlBlock::getTrackChannelFilter(TrackId trackId) const
 {
-    if (trackId < CONTROLBLOCK_MAX_NB_TRACKS)
+    if (trackId < m_trackInfo.size())
         return m_trackInfo[trackId].m_channelFilter;
     return -1;
 }
@@ -235,15 +245,15 @@ ControlBlock::getTrackChannelFilter(TrackId trackId) const
 
 void ControlBlock::setTrackDeviceFilter( TrackId  trackId,
                                          DeviceId device ) {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    m_trackInfo[trackId].m_deviceFilter = device;
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( track ) track->m_deviceFilter = device;
 }
 
 #if 0
 DeviceId 
 ControlBlock::getTrackDeviceFilter(TrackId trackId) const
 {
-    if (trackId < CONTROLBLOCK_MAX_NB_TRACKS)
+    if (trackId < m_trackInfo.size())
         return m_trackInfo[trackId].m_deviceFilter;
     return Device::ALL_DEVICES;
 }
@@ -251,13 +261,13 @@ ControlBlock::getTrackDeviceFilter(TrackId trackId) const
 
 void ControlBlock::setTrackThruRouting(
     TrackId trackId, Track::ThruRouting thruRouting ) {
-  if( trackId < CONTROLBLOCK_MAX_NB_TRACKS )
-    m_trackInfo[trackId].m_thruRouting = thruRouting;
+  TrackInfo *track = makeTrackInfo( trackId );
+  if( track ) track->m_thruRouting = thruRouting;
 }
 
 bool ControlBlock::isInstrumentMuted(
     InstrumentId instrumentId ) const {
-  for( unsigned int i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     if( m_trackInfo[i].m_instrumentId == instrumentId &&
         !m_trackInfo[i].m_deleted && !m_trackInfo[i].m_muted &&
         !m_trackInfo[i].m_archived )
@@ -268,7 +278,7 @@ bool ControlBlock::isInstrumentMuted(
 
 bool ControlBlock::isInstrumentUnused(
     InstrumentId instrumentId ) const {
-  for( unsigned int i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     if( m_trackInfo[i].m_instrumentId == instrumentId &&
         !m_trackInfo[i].m_deleted )
       return false;
@@ -279,7 +289,7 @@ bool ControlBlock::isInstrumentUnused(
 void ControlBlock::setSelectedTrack( TrackId track ) {
   // Undo the old selected track.  Safe even if it referred to
   // the same track or to no track.
-  if( m_selectedTrack < CONTROLBLOCK_MAX_NB_TRACKS ) {
+  if( m_selectedTrack < m_trackInfo.size() ) {
 #ifdef DEBUG_CONTROL_BLOCK
 #endif
     TrackInfo &oldTrack = m_trackInfo[m_selectedTrack];
@@ -288,12 +298,11 @@ void ControlBlock::setSelectedTrack( TrackId track ) {
   }
 
   // Set up the new selected track
-  if( track < CONTROLBLOCK_MAX_NB_TRACKS ) {
+  if( TrackInfo *newTrack = makeTrackInfo( track ) ) {
 #ifdef DEBUG_CONTROL_BLOCK
 #endif
-    TrackInfo &newTrack = m_trackInfo[track];
-    newTrack.m_selected = true;
-    newTrack.conform( m_doc->getStudio() );
+    newTrack->m_selected = true;
+    newTrack->conform( m_doc->getStudio() );
   }
   // What's selected is recorded both here and in the trackinfo
   // objects.
@@ -303,7 +312,7 @@ void ControlBlock::setSelectedTrack( TrackId track ) {
 InstrumentAndChannel ControlBlock::getInstAndChanForEvent(
     bool recording, DeviceId deviceId, char channel ) {
   // For each track
-  for( unsigned i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     TrackInfo &track = m_trackInfo[i];
 
     bool deviceMatch =
@@ -366,7 +375,7 @@ InstrumentAndChannel ControlBlock::getInstAndChanForEvent(
 // fixed channel has commandeered the channel.
 // @author Tom Breton (Tehom)
 void ControlBlock::vacateThruChannel( int channel ) {
-  for( unsigned int i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     TrackInfo &track = m_trackInfo[i];
     if( track.m_hasThruChannel &&
         ( track.m_thruChannel == channel ) &&
@@ -386,7 +395,7 @@ void ControlBlock::vacateThruChannel( int channel ) {
 // @author Tom Breton (Tehom)
 void ControlBlock::instrumentChangedProgram(
     InstrumentId instrumentId ) {
-  for( unsigned int i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     TrackInfo &track = m_trackInfo[i];
     if( track.m_hasThruChannel &&
         ( track.m_instrumentId == instrumentId ) ) {
@@ -399,7 +408,7 @@ void ControlBlock::instrumentChangedProgram(
 // @author Tom Breton (Tehom)
 void ControlBlock::instrumentChangedFixity(
     InstrumentId instrumentId ) {
-  for( unsigned int i = 0; i <= m_maxTrackId; ++i ) {
+  for( size_t i = 0; i < m_trackInfo.size(); ++i ) {
     TrackInfo &track = m_trackInfo[i];
     if( track.m_hasThruChannel &&
         ( track.m_instrumentId == instrumentId ) ) {
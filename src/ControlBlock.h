@@ -20,6 +20,8 @@
 #include "MidiProgram.h"  // InstrumentId, MidiFilter
 #include "Track.h"  // TrackId
 
+#include <vector>
+
 namespace Rosegarden 
 {
 
@@ -128,7 +130,6 @@ private:
     void allocateThruChannel(Studio &studio);
 };
 
-// should be high enough for the moment
 #define CONTROLBLOCK_MAX_NB_TRACKS 1024
 
 /// Control data passed from GUI thread to sequencer thread.
@@ -159,8 +160,6 @@ public:
 
     void setDocument(RosegardenDocument *doc);
 
-    //unsigned int getMaxTrackId() const { return m_maxTrackId; }
-
     /// Update m_trackInfo for the track.
     void updateTrackData(Track *);
 
@@ -227,9 +226,20 @@ private:
 
     void clearTracks();
 
-    RosegardenDocument *m_doc;
+    /// The TrackInfo for trackId, added if need be.
+    /**
+     * Returns nullptr for NO_TRACK and for TrackIds from
+     * CONTROLBLOCK_MAX_NB_TRACKS up, so a stray TrackId in a file can't
+     * make the table huge.  Invalidates any TrackInfo pointers or
+     * references held.
+     */
+    TrackInfo *makeTrackInfo(TrackId trackId);
+    /// The TrackInfo for trackId, or nullptr if it was never set.
+    const TrackInfo *findTrackInfo(TrackId trackId) const
+        { return trackId < m_trackInfo.size() ? &m_trackInfo[trackId] :
+                                                 nullptr; }
 
-    unsigned int m_maxTrackId;
+    RosegardenDocument *m_doc;
 
     bool m_isSelectedChannelReady;
     MidiFilter m_thruFilter;
@@ -239,7 +249,13 @@ private:
 
     TrackInfo m_metronomeInfo;
 
-    TrackInfo m_trackInfo[CONTROLBLOCK_MAX_NB_TRACKS];
+    /// Indexed by TrackId.
+    /**
+     * TrackIds are handed out from 0 up, so this is dense and grows with
+     * the Composition, to at most CONTROLBLOCK_MAX_NB_TRACKS.  Tracks
+     * never set are cleared, as are the gaps.
+     */
+    std::vector<TrackInfo> m_trackInfo;
 };
 
 }
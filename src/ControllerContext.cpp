@@ -27,6 +27,7 @@
 #include "MidiTypes.h"
 #include "Profiler.h"
 #include "Segment.h"
+#include "SegmentControllerIndex.h"
 
 #include <limits>
 
@@ -43,13 +44,17 @@ ControllerSearch::ControllerSearch( const std::string eventType,
 // segment s.
 // @author Tom Breton (Tehom)
 ControllerSearch::Maybe ControllerSearch::searchSegment(
-    const Segment *s, timeT noEarlierThan,
-    timeT noLaterThan ) const {
+    const Segment *s, const SegmentControllerIndex *index,
+    timeT noEarlierThan, timeT noLaterThan ) const {
   Profiler profiler( "ControllerSearch::searchSegment", false );
   if( !s ) {
     return Maybe( false, ControllerSearchValue( 0, 0 ) );
   }
 
+  if( index && SegmentControllerIndex::isIndexed( m_eventType ) )
+    return index->search( m_eventType, m_controllerId,
+                          noEarlierThan, noLaterThan );
+
   // Get the latest relevant event before or at noEarlierThan.
   Segment::reverse_iterator latest( s->findTime( noLaterThan ) );
 
@@ -76,16 +81,18 @@ ControllerSearch::Maybe ControllerSearch::searchSegment(
 // Search Segments A and B for the latest controller value.
 // Search A first.  B may be nullptr but A must exist.
 ControllerSearch::Maybe ControllerSearch::doubleSearch(
-    Segment *a, Segment *b, timeT noLaterThan ) const {
+    Segment *a, Segment *b, timeT noLaterThan,
+    const SegmentControllerIndex *aIndex,
+    const SegmentControllerIndex *bIndex ) const {
   Profiler profiler( "ControllerSearch::doubleSearch", false );
   ControllerSearch::Maybe runningResult = searchSegment(
-      a, std::numeric_limits<int>::min(), noLaterThan );
+      a, aIndex, std::numeric_limits<int>::min(), noLaterThan );
   if( b ) {
     timeT noEarlierThan = runningResult.first
                               ? runningResult.second.m_when
                               : std::numeric_limits<int>::min();
     ControllerSearch::Maybe result2 =
-        searchSegment( b, noEarlierThan, noLaterThan );
+        searchSegment( b, bIndex, noEarlierThan, noLaterThan );
     if( result2.first ) { runningResult = result2; }
   }
 
@@ -103,6 +110,36 @@ bool ControllerSearch::matches( Event *e ) const {
                  m_controllerId ) );
 }
 
+ControllerContextMap::~ControllerContextMap() {
+  for( std::map<const Segment *, SegmentControllerIndex *>::iterator
+           i = m_indexes.begin();
+       i != m_indexes.end(); ++i )
+    delete i->second;
+}
+
+// Get the index of segment s, making it if need be.
+SegmentControllerIndex *ControllerContextMap::getIndex(
+    Segment *s ) {
+  if( !s ) return nullptr;
+  SegmentControllerIndex *&index = m_indexes[s];
+  // A deleted Segment's index has no Segment, so if s is a new one
+  // at the same address, we start afresh.
+  if( index && index->getSegment() != s ) {
+    delete index;
+    index = nullptr;
+  }
+  if( !index ) index = new SegmentControllerIndex( *s );
+  return index;
+}
+
+// Search Segments A and B thru their indexes.
+ControllerContextMap::Maybe ControllerContextMap::search(
+    const ControllerSearch &params, Segment *a, Segment *b,
+    timeT noLaterThan ) {
+  return params.doubleSearch( a, b, noLaterThan, getIndex( a ),
+                              getIndex( b ) );
+}
+
 // Get the static value for the controller we are searching
 // about.
 // @author Tom Breton (Tehom)
@@ -185,7 +222,7 @@ int ControllerContextMap::getControllerValue(
   // Some non-static values exist for this controller but the
   // last value isn't it, so search.
   const ControllerSearch params( eventType, controllerId );
-  Maybe foundInEvents = params.doubleSearch( a, b, searchTime );
+  Maybe foundInEvents = search( params, a, b, searchTime );
 
   // Found it so we're done.
   if( foundInEvents.first ) {
@@ -246,8 +283,7 @@ void ControllerContextMap::makeControlValueAbsolute(
           ? e->get<Int>( Controller::NUMBER )
           : 0;
   const ControllerSearch  params( eventType, controllerId );
-  ControllerSearch::Maybe result =
-      params.doubleSearch( a, b, at );
+  ControllerSearch::Maybe result = search( params, a, b, at );
   int baseline;
   if( result.first ) {
     baseline = result.second.value();
@@ -29,6 +29,7 @@ namespace Rosegarden
   class ControlParameter;
   class Instrument;
   class Segment;
+  class SegmentControllerIndex;
 
 // @class ControllerSearchValue A (possibly intermediate) value in a
 // parameter search, including what time it was found at.
@@ -66,14 +67,18 @@ class ControllerSearch
                      int controllerId);
     
     // Search Segments A and B for the latest controller value.  B may
-    // be nullptr but A must exist. 
+    // be nullptr but A must exist.  If given, the indexes of A and B
+    // are searched rather than the Segments themselves.
     Maybe
-        doubleSearch(Segment *a, Segment *b, timeT noLaterThan) const;
+        doubleSearch(Segment *a, Segment *b, timeT noLaterThan,
+                     const SegmentControllerIndex *aIndex = nullptr,
+                     const SegmentControllerIndex *bIndex = nullptr) const;
 
  private:
     Maybe
-        searchSegment(const Segment *s, timeT noEarlierThan,
-                      timeT noLaterThan) const;
+        searchSegment(const Segment *s,
+                      const SegmentControllerIndex *index,
+                      timeT noEarlierThan, timeT noLaterThan) const;
     bool matches(Event *e) const;
 
     const std::string  m_eventType;
@@ -93,6 +98,7 @@ struct ControllerContextMap
  ControllerContextMap() :
     m_PitchBendLatestValue(Maybe(false,ControllerSearchValue()))
     {};
+    ~ControllerContextMap();
 
     void makeControlValueAbsolute(Instrument *instrument, Segment *a,
                                   Segment *b, Event *e, timeT at);
@@ -108,9 +114,19 @@ struct ControllerContextMap
                            int controllerId);
 
     void storeLatestValue(Event *e);
+    // Clear the cache.  The indexes stay, as they keep themselves up
+    // to date.
     void clear();
 
  private:
+    // Hide copy ctor and op= since dtor is non-trivial.
+    ControllerContextMap(const ControllerContextMap &);
+    ControllerContextMap &operator=(const ControllerContextMap &);
+
+    Maybe search(const ControllerSearch &params, Segment *a, Segment *b,
+                 timeT noLaterThan);
+    SegmentControllerIndex *getIndex(Segment *s);
+
     int makeAbsolute(const ControlParameter * controlParameter,
                      int value) const;
     const ControlParameter
@@ -123,6 +139,9 @@ struct ControllerContextMap
 
     Cache             m_latestValues;
     Maybe             m_PitchBendLatestValue;
+    // Controller indexes of the Segments searched, made on first
+    // search.
+    std::map<const Segment *, SegmentControllerIndex *> m_indexes;
  };
 
 class ControllerContextParams
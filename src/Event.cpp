@@ -23,12 +23,31 @@
 #include "NotationTypes.h"
 #include "XmlExportable.h"
 
+#include <cstring>
 #include <sstream>
 
 namespace Rosegarden {
 using std::ostream;
 using std::string;
 
+namespace {
+
+// Where the name starts in an entry of EventData::m_unparsed, after
+// the type and the interned value.
+const size_t UnparsedNameOffset = 1 + sizeof( int );
+
+int unparsedNameValue( const string &u, size_t pos ) {
+  int value;
+  std::memcpy( &value, u.data() + pos + 1, sizeof( value ) );
+  return value;
+}
+
+unsigned int unparsedBit( int nameValue ) {
+  return 1u << ( static_cast<unsigned int>( nameValue ) % 32 );
+}
+
+} // namespace
+
 PropertyName Event::EventData::NotationTime = "!notationtime";
 PropertyName Event::EventData::NotationDuration =
     "!notationduration";
@@ -41,58 +60,88 @@ Event::EventData::EventData( const std::string &type,
     m_absoluteTime( absoluteTime ),
     m_duration( duration ),
     m_subOrdering( subOrdering ),
-    m_properties( nullptr ) {
-  // empty
-}
-
-Event::EventData::EventData( const std::string &type,
-                             timeT absoluteTime, timeT duration,
-                             short              subOrdering,
-                             const PropertyMap *properties )
-  : m_refCount( 1 ),
-    m_type( type ),
-    m_absoluteTime( absoluteTime ),
-    m_duration( duration ),
-    m_subOrdering( subOrdering ),
-    m_properties( properties ? new PropertyMap( *properties )
-                             : nullptr ) {
+    m_properties( nullptr ),
+    m_unparsed( nullptr ),
+    m_hotMask( 0 ),
+    m_unparsedMask( 0 ),
+    m_hotValues() {
   // empty
 }
 
 Event::EventData *Event::EventData::unshare() {
-  --m_refCount;
-
-  EventData *newData =
-      new EventData( m_type, m_absoluteTime, m_duration,
-                     m_subOrdering, m_properties );
+  EventData *newData = new EventData( m_type, m_absoluteTime,
+                                      m_duration, m_subOrdering );
+  // The properties are only copied when one of us changes them.
+  newData->m_propertyStore = m_propertyStore;
+  newData->m_properties    = m_properties;
+  newData->m_hotMask       = m_hotMask;
+  for( int i = 0; i < HotSlotCount; ++i )
+    newData->m_hotValues[i] = m_hotValues[i];
+  if( m_unparsed ) newData->m_unparsed = new string( *m_unparsed );
+  newData->m_unparsedMask = m_unparsedMask;
+
+  // Another sharer may have let go since the caller checked.
+  if( m_refCount.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    delete this;
 
   return newData;
 }
 
-Event::EventData::~EventData() {
-  if( m_properties ) delete m_properties;
+Event::EventData::~EventData() { delete m_unparsed; }
+
+void Event::EventData::unshareProperties() {
+  // Nobody else can start sharing it meanwhile: they would need
+  // this EventData, which is ours alone when we get here.
+  if( m_propertyStore.use_count() > 1 ) {
+    m_propertyStore =
+        std::make_shared<PropertyMap>( *m_propertyStore );
+    m_properties = m_propertyStore.get();
+  }
 }
 
-timeT Event::EventData::getNotationTime() const {
-  if( !m_properties ) return m_absoluteTime;
-  PropertyMap::const_iterator i =
-      m_properties->find( NotationTime );
-  if( i == m_properties->end() )
-    return m_absoluteTime;
-  else
-    return static_cast<PropertyStore<Int> *>( i->second )
-        ->getData();
+PropertyMap *Event::EventData::ownProperties() {
+  if( !m_propertyStore ) {
+    m_propertyStore = std::make_shared<PropertyMap>();
+    m_properties    = m_propertyStore.get();
+  } else {
+    unshareProperties();
+  }
+  return m_properties;
+}
+
+int Event::EventData::getHotSlot( const PropertyName &name ) {
+  using namespace BaseProperties;
+
+  if( name == NotationTime ) return HotNotationTime;
+  if( name == NotationDuration ) return HotNotationDuration;
+  if( name == PITCH ) return HotPitch;
+  if( name == VELOCITY ) return HotVelocity;
+  if( name == TRIGGER_SEGMENT_ID ) return HotTriggerSegmentId;
+  if( name == TIED_FORWARD ) return HotTiedForward;
+  if( name == TIED_BACKWARD ) return HotTiedBackward;
+  if( name == IS_GRACE_NOTE ) return HotIsGraceNote;
+  if( name == MAY_HAVE_GRACE_NOTES ) return HotMayHaveGraceNotes;
+  return -1;
 }
 
-timeT Event::EventData::getNotationDuration() const {
-  if( !m_properties ) return m_duration;
-  PropertyMap::const_iterator i =
-      m_properties->find( NotationDuration );
-  if( i == m_properties->end() )
-    return m_duration;
+void Event::EventData::syncHotSlot( int                 slot,
+                                    const PropertyName &name ) {
+  m_hotMask &= ~( 1u << slot );
+  if( !m_properties ) return;
+
+  PropertyMap::const_iterator i = m_properties->find( name );
+  if( i == m_properties->end() ) return;
+
+  PropertyStoreBase *sb = i->second;
+  if( sb->getType() != getHotSlotType( slot ) ) return;
+
+  if( sb->getType() == Int )
+    m_hotValues[slot] =
+        static_cast<PropertyStore<Int> *>( sb )->getData();
   else
-    return static_cast<PropertyStore<Int> *>( i->second )
-        ->getData();
+    m_hotValues[slot] =
+        static_cast<PropertyStore<Bool> *>( sb )->getData();
+  m_hotMask |= ( 1u << slot );
 }
 
 timeT Event::getGreaterDuration() {
@@ -104,7 +153,15 @@ timeT Event::getGreaterDuration() {
 
 void Event::EventData::setTime( const PropertyName &name,
                                 timeT t, timeT deft ) {
-  if( !m_properties ) m_properties = new PropertyMap();
+  // Don't make a map of our own if there is nothing to change.
+  if( t == deft &&
+      ( !m_properties || m_properties->find( name ) ==
+                             m_properties->end() ) ) {
+    syncHotSlot( name );
+    return;
+  }
+
+  ownProperties();
   PropertyMap::iterator i = m_properties->find( name );
 
   if( t != deft ) {
@@ -119,6 +176,8 @@ void Event::EventData::setTime( const PropertyName &name,
     delete i->second;
     m_properties->erase( i );
   }
+
+  syncHotSlot( name );
 }
 
 PropertyMap *Event::find( const PropertyName &   name,
@@ -141,12 +200,104 @@ bool Event::has( const PropertyName &name ) const {
   ++m_hasCount;
 #endif
 
+  int slot = EventData::getHotSlot( name );
+  if( slot >= 0 && m_data->hasHotSlot( slot ) ) return true;
+
   PropertyMap::const_iterator i;
   const PropertyMap *         map = find( name, i );
   if( map )
     return true;
   else
-    return false;
+    return findUnparsed( name ) != string::npos;
+}
+
+bool Event::setUnparsed( const PropertyName &name,
+                         PropertyType type, const string &value ) {
+  if( has( name ) ) return false;
+
+  unshare();
+  if( !m_data->m_unparsed ) m_data->m_unparsed = new string;
+  string &u         = *m_data->m_unparsed;
+  int     nameValue = name.getValue();
+  u += static_cast<char>( type );
+  u.append( reinterpret_cast<const char *>( &nameValue ),
+            sizeof( nameValue ) );
+  u += name.getName();
+  u += '\0';
+  u += value;
+  u += '\0';
+  m_data->m_unparsedMask |= unparsedBit( nameValue );
+  return true;
+}
+
+size_t Event::findUnparsed( const PropertyName &name ) const {
+  const string *u = m_data->m_unparsed;
+  if( !u ) return string::npos;
+
+  int nameValue = name.getValue();
+  if( !( m_data->m_unparsedMask & unparsedBit( nameValue ) ) )
+    return string::npos;
+
+  size_t pos = 0;
+  while( pos < u->size() ) {
+    if( unparsedNameValue( *u, pos ) == nameValue ) return pos;
+    size_t nameEnd = u->find( '\0', pos + UnparsedNameOffset );
+    pos            = u->find( '\0', nameEnd + 1 ) + 1;
+  }
+  return string::npos;
+}
+
+bool Event::getUnparsed( const PropertyName &name,
+                         PropertyType &type, string &value ) const {
+  size_t pos = findUnparsed( name );
+  if( pos == string::npos ) return false;
+
+  const string &u       = *m_data->m_unparsed;
+  size_t        nameEnd = u.find( '\0', pos + UnparsedNameOffset );
+  type  = static_cast<PropertyType>( u[pos] );
+  value = u.substr( nameEnd + 1,
+                    u.find( '\0', nameEnd + 1 ) - nameEnd - 1 );
+  return true;
+}
+
+void Event::parseUnparsed( const PropertyName &name ) {
+  PropertyType type;
+  string       value;
+  if( !getUnparsed( name, type, value ) ) return;
+
+  unshare();
+
+  string &u       = *m_data->m_unparsed;
+  size_t  pos     = findUnparsed( name );
+  size_t  nameEnd = u.find( '\0', pos + UnparsedNameOffset );
+  u.erase( pos, u.find( '\0', nameEnd + 1 ) + 1 - pos );
+  // The mask may keep the name's bit; it only saves lookups.
+  if( u.empty() ) {
+    delete m_data->m_unparsed;
+    m_data->m_unparsed     = nullptr;
+    m_data->m_unparsedMask = 0;
+  }
+
+  PropertyStoreBase *p;
+  switch( type ) {
+    case Int:
+      p = new PropertyStore<Int>( PropertyDefn<Int>::parse( value ) );
+      break;
+    case Bool:
+      p = new PropertyStore<Bool>(
+          PropertyDefn<Bool>::parse( value ) );
+      break;
+    default:
+      p = new PropertyStore<String>( value );
+      break;
+  }
+  // setUnparsed() keeps names from being in both, but don't leak
+  // p if one is.
+  if( !m_data->ownProperties()
+           ->insert( PropertyPair( name, p ) )
+           .second )
+    delete p;
+  m_data->syncHotSlot( name );
 }
 
 void Event::unset( const PropertyName &name ) {
@@ -155,11 +306,14 @@ void Event::unset( const PropertyName &name ) {
 #endif
 
   unshare();
+  m_data->unshareProperties();
+  if( m_data->m_unparsed ) parseUnparsed( name );
   PropertyMap::iterator i;
   PropertyMap *         map = find( name, i );
   if( map ) {
     delete i->second;
     map->erase( i );
+    if( map == m_data->m_properties ) m_data->syncHotSlot( name );
   }
 }
 
@@ -169,8 +323,12 @@ PropertyType Event::getPropertyType(
 {
   PropertyMap::const_iterator i;
   const PropertyMap *         map = find( name, i );
+  PropertyType                type;
+  string                      value;
   if( map ) {
     return i->second->getType();
+  } else if( getUnparsed( name, type, value ) ) {
+    return type;
   } else {
     throw NoData( name.getName(), __FILE__, __LINE__ );
   }
@@ -182,8 +340,16 @@ string Event::getPropertyTypeAsString(
 {
   PropertyMap::const_iterator i;
   const PropertyMap *         map = find( name, i );
+  PropertyType                type;
+  string                      value;
   if( map ) {
     return i->second->getTypeName();
+  } else if( getUnparsed( name, type, value ) ) {
+    switch( type ) {
+      case Int: return PropertyDefn<Int>::typeName();
+      case Bool: return PropertyDefn<Bool>::typeName();
+      default: return PropertyDefn<String>::typeName();
+    }
   } else {
     throw NoData( name.getName(), __FILE__, __LINE__ );
   }
@@ -194,8 +360,12 @@ string Event::getAsString( const PropertyName &name ) const
 {
   PropertyMap::const_iterator i;
   const PropertyMap *         map = find( name, i );
+  PropertyType                type;
+  string                      value;
   if( map ) {
     return i->second->unparse();
+  } else if( getUnparsed( name, type, value ) ) {
+    return value;
   } else {
     throw NoData( name.getName(), __FILE__, __LINE__ );
   }
@@ -308,6 +478,14 @@ void Event::dump( ostream &out ) const {
     }
   }
 
+  PropertyNames unparsed;
+  getUnparsedNames( unparsed );
+  for( PropertyNames::const_iterator i = unparsed.begin();
+       i != unparsed.end(); ++i ) {
+    out << "\t\t" << i->getName() << " (unparsed) \t"
+        << getAsString( *i ) << "\n";
+  }
+
   if( m_nonPersistentProperties ) {
     out << "\n\tNon-persistent properties : \n";
 
@@ -371,6 +549,7 @@ Event::PropertyNames Event::getPropertyNames() const {
       v.push_back( i->first );
     }
   }
+  getUnparsedNames( v );
   if( m_nonPersistentProperties ) {
     for( PropertyMap::const_iterator i =
              m_nonPersistentProperties->begin();
@@ -390,9 +569,24 @@ Event::PropertyNames Event::getPersistentPropertyNames() const {
       v.push_back( i->first );
     }
   }
+  getUnparsedNames( v );
   return v;
 }
 
+void Event::getUnparsedNames( PropertyNames &v ) const {
+  const string *u = m_data->m_unparsed;
+  if( !u ) return;
+
+  size_t pos = 0;
+  while( pos < u->size() ) {
+    // The name was interned when the entry was made, so this
+    // doesn't touch the intern table.
+    v.push_back( PropertyName( unparsedNameValue( *u, pos ), true ) );
+    size_t nameEnd = u->find( '\0', pos + UnparsedNameOffset );
+    pos            = u->find( '\0', nameEnd + 1 ) + 1;
+  }
+}
+
 Event::PropertyNames Event::getNonPersistentPropertyNames()
     const {
   PropertyNames v;
@@ -431,6 +625,7 @@ size_t Event::getStorageSize() const {
       s += i->second->getStorageSize();
     }
   }
+  if( m_data->m_unparsed ) s += m_data->m_unparsed->size();
   if( m_nonPersistentProperties ) {
     for( PropertyMap::const_iterator i =
              m_nonPersistentProperties->begin();
@@ -442,6 +637,23 @@ size_t Event::getStorageSize() const {
   return s;
 }
 
+bool Event::shareProperties( const Event &e ) {
+  if( m_data->m_properties == e.m_data->m_properties ) return true;
+  if( !m_data->m_properties || !e.m_data->m_properties ) return false;
+  if( *m_data->m_properties != *e.m_data->m_properties ) return false;
+
+  // The unparsed properties are part of the set too.
+  const string *u = m_data->m_unparsed;
+  const string *v = e.m_data->m_unparsed;
+  if( ( u || v ) && ( !u || !v || *u != *v ) ) return false;
+
+  // Equal maps mean equal hot slots, so those stay as they are.
+  unshare();
+  m_data->m_propertyStore = e.m_data->m_propertyStore;
+  m_data->m_properties    = e.m_data->m_properties;
+  return true;
+}
+
 bool operator<( const Event &a, const Event &b ) {
   timeT at = a.getAbsoluteTime();
   timeT bt = b.getAbsoluteTime();
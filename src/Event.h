@@ -17,6 +17,8 @@
 #include "PropertyMap.h"
 #include "Exception.h"
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <iostream> // TODO remove (after changing the dump() signature)
@@ -277,6 +279,20 @@ public:
     void setFromString(const PropertyName &name, std::string value,
                        bool persistent = true);
 
+    /**
+     * Store a persistent property in unparsed form.  It is not
+     * parsed, and takes no PropertyStore, until it is modified; get()
+     * and has() parse it on the fly from the stored text without
+     * changing the Event.  Intended for file readers that load many
+     * properties which are seldom looked at.
+     * \param name the name of the property
+     * \param type Int, String or Bool
+     * \param value the value in the form PropertyDefn<P>::unparse() produces
+     * \return false, leaving the Event as it was, if it already has a property of that name
+     */
+    bool setUnparsed(const PropertyName &name, PropertyType type,
+                     const std::string &value);
+
     /**
      * Destroy the specified property/data
      *
@@ -368,6 +384,14 @@ public:
     // approximate, for debugging and inspection purposes
     size_t getStorageSize() const;
 
+    /**
+     * If e has the same persistent properties as this Event, share
+     * e's storage for them rather than keep a copy, and return true.
+     * The properties are copied again when either Event changes them.
+     * For linked segments, whose events are largely the same.
+     */
+    bool shareProperties(const Event &e);
+
     /**
      * Get the XML string representing the object.
      */
@@ -409,12 +433,12 @@ private:
     {
         EventData(const std::string &type,
                   timeT absoluteTime, timeT duration, short subOrdering);
-        EventData(const std::string &type,
-                  timeT absoluteTime, timeT duration, short subOrdering,
-                  const PropertyMap *properties);
         EventData *unshare();
         ~EventData();
-        unsigned int m_refCount;
+        // Atomic so that Events sharing data may be copied and
+        // destroyed from several threads, e.g. while reading a frozen
+        // Composition.
+        std::atomic<unsigned int> m_refCount;
 
         std::string m_type;
         timeT m_absoluteTime;
@@ -422,12 +446,31 @@ private:
         short m_subOrdering;
 
         PropertyMap *m_properties;
+        // Owns m_properties, which may be shared with other EventData
+        // (copy-on-write).  Call unshareProperties() before changing
+        // anything in it, or ownProperties() to also make sure there
+        // is one.
+        std::shared_ptr<PropertyMap> m_propertyStore;
+        void unshareProperties();
+        PropertyMap *ownProperties();
+
+        // Persistent properties not parsed yet (see setUnparsed), as
+        // a sequence of type, interned name value (an int), name,
+        // '\0', value, '\0'.  A name never appears both here and in
+        // m_properties.
+        std::string *m_unparsed;
 
         // These are properties because we don't care so much about
         // raw speed in get/set, but we do care about storage size for
         // events that don't have them or that have zero values:
-        timeT getNotationTime() const;
-        timeT getNotationDuration() const;
+        timeT getNotationTime() const {
+            return hasHotSlot(HotNotationTime) ?
+                m_hotValues[HotNotationTime] : m_absoluteTime;
+        }
+        timeT getNotationDuration() const {
+            return hasHotSlot(HotNotationDuration) ?
+                m_hotValues[HotNotationDuration] : m_duration;
+        }
         void setNotationTime(timeT t) {
             setTime(NotationTime, t, m_absoluteTime);
         }
@@ -435,6 +478,49 @@ private:
             setTime(NotationDuration, d, m_duration);
         }
 
+        /**
+         * Hot slots.  The handful of properties that the mapper and
+         * the performance helper read for every event are mirrored
+         * into these inline fields, so that reading them does not
+         * involve a map lookup.  The persistent property map remains
+         * authoritative: a slot is present (its bit is set in
+         * m_hotMask) exactly when m_properties holds that property
+         * with the slot's type, and syncHotSlot() must be called
+         * whenever such an entry is added, changed or removed.
+         */
+        enum HotSlot {
+            HotNotationTime,
+            HotNotationDuration,
+            HotPitch,
+            HotVelocity,
+            HotTriggerSegmentId,
+            HotTiedForward,
+            HotTiedBackward,
+            HotIsGraceNote,
+            HotMayHaveGraceNotes,
+            HotSlotCount
+        };
+
+        unsigned int m_hotMask;
+        // Bit (value % 32) is set for the interned value of every name
+        // in m_unparsed, so that most misses needn't look there.
+        unsigned int m_unparsedMask;
+        long m_hotValues[HotSlotCount];
+
+        /// Returns the slot for the given name, or -1 if it has none.
+        static int getHotSlot(const PropertyName &name);
+        static PropertyType getHotSlotType(int slot) {
+            return slot < HotTiedForward ? Int : Bool;
+        }
+        bool hasHotSlot(int slot) const {
+            return (m_hotMask & (1u << slot)) != 0;
+        }
+        void syncHotSlot(const PropertyName &name) {
+            int slot = getHotSlot(name);
+            if (slot >= 0) syncHotSlot(slot, name);
+        }
+        void syncHotSlot(int slot, const PropertyName &name);
+
     private:
         EventData(const EventData &);
         EventData &operator=(const EventData &);
@@ -448,11 +534,11 @@ private:
 
     void share(const Event &e) {
         m_data = e.m_data;
-        m_data->m_refCount++;
+        m_data->m_refCount.fetch_add(1, std::memory_order_relaxed);
     }
 
     bool unshare() { // returns true if unshare was necessary
-        if (m_data->m_refCount > 1) {
+        if (m_data->m_refCount.load(std::memory_order_acquire) > 1) {
             m_data = m_data->unshare();
             return true;
         } else {
@@ -461,7 +547,8 @@ private:
     }
 
     void lose() {
-        if (--m_data->m_refCount == 0) delete m_data;
+        if (m_data->m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete m_data;
         delete m_nonPersistentProperties;
         m_nonPersistentProperties = nullptr;
     }
@@ -478,10 +565,30 @@ private:
     }
 
     PropertyMap::iterator insert(const PropertyPair &pair, bool persistent) {
-        PropertyMap **map =
-            (persistent ? &m_data->m_properties : &m_nonPersistentProperties);
-        if (!*map) *map = new PropertyMap();
-        return (*map)->insert(pair).first;
+        if (persistent)
+            return m_data->ownProperties()->insert(pair).first;
+        if (!m_nonPersistentProperties)
+            m_nonPersistentProperties = new PropertyMap();
+        return m_nonPersistentProperties->insert(pair).first;
+    }
+
+    // Unparsed properties.  findUnparsed() returns the offset of the
+    // entry for name in m_data->m_unparsed, or std::string::npos.
+    size_t findUnparsed(const PropertyName &name) const;
+    bool getUnparsed(const PropertyName &name, PropertyType &type,
+                     std::string &value) const;
+    // Moves the named property, if it is unparsed, into m_properties.
+    void parseUnparsed(const PropertyName &name);
+    // Appends the names of the unparsed properties, as interned when
+    // they were set, so it is safe on a frozen Composition.
+    void getUnparsedNames(PropertyNames &) const;
+
+    // Fast path for properties mirrored into EventData hot slots.
+    // Returns false if the value has to be looked up in the maps.
+    template <PropertyType P>
+    bool getHot(const PropertyName &,
+                typename PropertyDefn<P>::basic_type &) const {
+        return false;
     }
 
 #ifndef NDEBUG
@@ -495,6 +602,30 @@ private:
 };
 
 
+template <>
+inline bool
+Event::getHot<Int>(const PropertyName &name, PropertyDefn<Int>::basic_type &val) const
+{
+    int slot = EventData::getHotSlot(name);
+    if (slot < 0 || !m_data->hasHotSlot(slot) ||
+        EventData::getHotSlotType(slot) != Int) return false;
+    val = m_data->m_hotValues[slot];
+    return true;
+}
+
+
+template <>
+inline bool
+Event::getHot<Bool>(const PropertyName &name, PropertyDefn<Bool>::basic_type &val) const
+{
+    int slot = EventData::getHotSlot(name);
+    if (slot < 0 || !m_data->hasHotSlot(slot) ||
+        EventData::getHotSlotType(slot) != Bool) return false;
+    val = (m_data->m_hotValues[slot] != 0);
+    return true;
+}
+
+
 template <PropertyType P>
 bool
 Event::get(const PropertyName &name, typename PropertyDefn<P>::basic_type &val) const
@@ -503,6 +634,8 @@ Event::get(const PropertyName &name, typename PropertyDefn<P>::basic_type &val)
     ++m_getCount;
 #endif
 
+    if (getHot<P>(name, val)) return true;
+
     PropertyMap::const_iterator i;
     const PropertyMap *map = find(name, i);
 
@@ -518,7 +651,11 @@ Event::get(const PropertyName &name, typename PropertyDefn<P>::basic_type &val)
         }
 
     } else {
-        return false;
+        PropertyType type;
+        std::string value;
+        if (!getUnparsed(name, type, value) || type != P) return false;
+        val = PropertyDefn<P>::parse(value);
+        return true;
     }
 }
 
@@ -532,6 +669,9 @@ Event::get(const PropertyName &name) const
     ++m_getCount;
 #endif
 
+    typename PropertyDefn<P>::basic_type val;
+    if (getHot<P>(name, val)) return val;
+
     PropertyMap::const_iterator i;
     const PropertyMap *map = find(name, i);
 
@@ -548,7 +688,17 @@ Event::get(const PropertyName &name) const
 
     } else {
 
-        throw NoData(name.getName(), __FILE__, __LINE__);
+        PropertyType type;
+        std::string value;
+        if (!getUnparsed(name, type, value))
+            throw NoData(name.getName(), __FILE__, __LINE__);
+        if (type != P) {
+            throw BadType(name.getName(),
+                          PropertyDefn<P>::typeName(),
+                          getPropertyTypeAsString(name),
+                          __FILE__, __LINE__);
+        }
+        return PropertyDefn<P>::parse(value);
     }
 }
 
@@ -563,6 +713,8 @@ Event::isPersistent(const PropertyName &name) const
 
     if (map) {
         return (map == m_data->m_properties);
+    } else if (findUnparsed(name) != std::string::npos) {
+        return true;
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -575,12 +727,15 @@ Event::setPersistence(const PropertyName &name, bool persistent)
     // throw (NoData)
 {
     unshare();
+    m_data->unshareProperties();
+    if (m_data->m_unparsed) parseUnparsed(name);
     PropertyMap::iterator i;
     PropertyMap *map = find(name, i);
 
     if (map) {
         insert(*i, persistent);
         map->erase(i);
+        m_data->syncHotSlot(name);
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -600,6 +755,8 @@ Event::set(const PropertyName &name, typename PropertyDefn<P>::basic_type value,
     // this is a little slow, could bear improvement
 
     unshare();
+    m_data->unshareProperties();
+    if (m_data->m_unparsed) parseUnparsed(name);
     PropertyMap::iterator i;
     PropertyMap *map = find(name, i);
 
@@ -614,6 +771,7 @@ Event::set(const PropertyName &name, typename PropertyDefn<P>::basic_type value,
         if (sb->getType() == P) {
             (static_cast<PropertyStore<P> *>(sb))->setData(value);
         } else {
+            m_data->syncHotSlot(name);
             throw BadType(name.getName(),
                           PropertyDefn<P>::typeName(), sb->getTypeName(),
                           __FILE__, __LINE__);
@@ -623,6 +781,8 @@ Event::set(const PropertyName &name, typename PropertyDefn<P>::basic_type value,
         PropertyStoreBase *p = new PropertyStore<P>(value);
         insert(PropertyPair(name, p), persistent);
     }
+
+    m_data->syncHotSlot(name);
 }
 
 
@@ -640,7 +800,10 @@ Event::setMaybe(const PropertyName &name, typename PropertyDefn<P>::basic_type v
     ++m_setMaybeCount;
 #endif
 
-    unshare();
+    // No unshare(): this only ever writes the non-persistent map,
+    // which belongs to this Event alone.
+    if (findUnparsed(name) != std::string::npos) return; // persistent
+
     PropertyMap::iterator i;
     PropertyMap *map = find(name, i);
 
@@ -0,0 +1,76 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8
+ * sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.  See
+   the file COPYING included with this distribution for more
+   information.
+*/
+
+#include "ExcerptInserter.h"
+
+namespace Rosegarden {
+
+ExcerptInserter::ExcerptInserter( MappedInserterBase &inserter,
+                                  RealTime            start,
+                                  RealTime            end )
+  : m_inserter( inserter ), m_start( start ), m_end( end ) {}
+
+void ExcerptInserter::insertCopy( const MappedEvent &evt ) {
+  bool isNote = evt.getType() == MappedEvent::MidiNote ||
+                evt.getType() == MappedEvent::MidiNoteOneShot;
+  bool isNoteOn = isNote && evt.getData2() > 0;
+
+  // Before the start only notes still sounding there are wanted.
+  // A note-off at the start ends a note that isn't.
+  if( evt.getEventTime() < m_start ) {
+    if( !isNoteOn ||
+        evt.getEventTime() + evt.getDuration() <= m_start )
+      return;
+  } else if( isNote && !isNoteOn &&
+             evt.getEventTime() == m_start ) {
+    return;
+  }
+
+  // Notes that start at the end are after it.
+  if( isNoteOn && evt.getEventTime() >= m_end ) return;
+
+  // One-shot notes have no note-off to wait for.
+  if( evt.getType() == MappedEvent::MidiNote ) {
+    NoteKey key( evt.getTrackId(),
+                 evt.getRecordedChannel() * 128 + evt.getData1() );
+    OpenNotes &notes = m_openNotes[key];
+    if( isNoteOn ) {
+      ++notes.m_count;
+      notes.m_note = evt;
+    } else {
+      --notes.m_count;
+    }
+  }
+
+  m_inserter.insertCopy( evt );
+}
+
+void ExcerptInserter::closeNotes() {
+  for( OpenNoteMap::iterator i = m_openNotes.begin();
+       i != m_openNotes.end(); ++i ) {
+    // As InternalSegmentMapper::popInsertNoteoff() makes them.
+    MappedEvent noteOff( i->second.m_note );
+    noteOff.setEventTime( m_end );
+    noteOff.setDuration( RealTime::zeroTime );
+    noteOff.setVelocity( 0 );
+    for( int n = 0; n < i->second.m_count; ++n )
+      m_inserter.insertCopy( noteOff );
+  }
+  m_openNotes.clear();
+}
+
+} // namespace Rosegarden
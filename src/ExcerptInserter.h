@@ -0,0 +1,78 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_EXCERPTINSERTER_H
+#define RG_EXCERPTINSERTER_H
+
+#include "MappedInserterBase.h"
+#include "MappedEvent.h"
+
+#include <map>
+#include <utility>
+
+namespace Rosegarden
+{
+
+/// Passes on the events fetched for a span of time, and no others.
+/**
+ * MappedBufMetaIterator::jumpToTime() leaves each buffer at its first
+ * event still sounding at the start, so fetchEvents() also gives the
+ * events after it that are over by then.  Of those only the notes
+ * still sounding at the start are wanted, to be struck again there.
+ * Notes are also fetched that start at the end, with the note-offs
+ * there.
+ *
+ * The note-offs of notes still sounding at the end are never fetched,
+ * so closeNotes() makes them.
+ *
+ * The events needn't come in time order.  See MidiFile::convertToMidi().
+ *
+ * The inserter is not owned.
+ */
+class ExcerptInserter : public MappedInserterBase
+{
+public:
+    ExcerptInserter(MappedInserterBase &inserter,
+                    RealTime start, RealTime end);
+
+    void insertCopy(const MappedEvent &evt) override;
+
+    /// Insert a note-off at the end for each note still sounding there.
+    void closeNotes();
+
+private:
+    /// A track and its channel * 128 + pitch.
+    typedef std::pair<TrackId, int> NoteKey;
+
+    /// How many notes of a pitch have been struck and not let go.
+    struct OpenNotes
+    {
+        OpenNotes() : m_count(0) { }
+
+        int m_count;
+        /// The last of them struck.
+        MappedEvent m_note;
+    };
+    typedef std::map<NoteKey, OpenNotes> OpenNoteMap;
+
+    MappedInserterBase &m_inserter;
+    RealTime m_start;
+    RealTime m_end;
+    OpenNoteMap m_openNotes;
+};
+
+}
+
+#endif /* ifndef RG_EXCERPTINSERTER_H */
@@ -0,0 +1,29 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8
+ * sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.  See
+   the file COPYING included with this distribution for more
+   information.
+*/
+
+#include "FanOutInserter.h"
+
+namespace Rosegarden {
+
+void FanOutInserter::insertCopy( const MappedEvent &evt ) {
+  for( std::vector<MappedInserterBase *>::const_iterator i =
+           m_inserters.begin();
+       i != m_inserters.end(); ++i )
+    ( *i )->insertCopy( evt );
+}
+
+} // namespace Rosegarden
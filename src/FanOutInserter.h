@@ -0,0 +1,48 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_FANOUTINSERTER_H
+#define RG_FANOUTINSERTER_H
+
+#include "MappedInserterBase.h"
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+/// Copies each event to several inserters.
+/**
+ * This lets one pass over the mapped (and sorted) events feed several
+ * MidiInserters with different settings, so that several MIDI files
+ * can be written from one mapping.  See MidiFile::convertToMidi().
+ *
+ * The inserters are not owned.
+ */
+class FanOutInserter : public MappedInserterBase
+{
+public:
+    void addInserter(MappedInserterBase *inserter)
+        { m_inserters.push_back(inserter); }
+
+    void insertCopy(const MappedEvent &evt) override;
+
+private:
+    std::vector<MappedInserterBase *> m_inserters;
+};
+
+}
+
+#endif /* ifndef RG_FANOUTINSERTER_H */
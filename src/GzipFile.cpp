@@ -23,6 +23,8 @@
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
 namespace Rosegarden {
 
 bool GzipFile::writeToFile( std::string file,
@@ -42,8 +44,19 @@ bool GzipFile::writeToFile( std::string file,
 
 bool GzipFile::readFromFile( std::string  file,
                              std::string &text ) {
-  text      = "";
-  gzFile fd = gzopen( file.data(), "rb" );
+  text = "";
+
+  // "-" is standard input.  zlib closes the descriptor it is
+  // given, so give it a copy.
+  gzFile fd;
+  if( file == "-" ) {
+    int in = ::dup( STDIN_FILENO );
+    if( in < 0 ) return false;
+    fd = gzdopen( in, "rb" );
+    if( !fd ) ::close( in );
+  } else {
+    fd = gzopen( file.data(), "rb" );
+  }
   if( !fd ) return false;
 
   std::vector<char> ba;
@@ -40,16 +40,24 @@
 
 #include <algorithm>
 #include <limits>
+#include <vector>
 
 // #define DEBUG_INTERNAL_SEGMENT_MAPPER 1
 
 namespace Rosegarden {
 
 InternalSegmentMapper::InternalSegmentMapper(
-    RosegardenDocument *doc, Segment *segment )
+    RosegardenDocument *doc, Segment *segment,
+    std::shared_ptr<LinkedSegmentMappings> linkedMappings,
+    bool deferChannelAllocation )
   : SegmentMapper( doc, segment ),
     m_channelManager( doc->getInstrument( segment ) ),
-    m_triggeredEvents( new Segment ) {}
+    m_triggeredEvents( new Segment ),
+    m_soundingIndex( *segment ),
+    m_linkedMappings( linkedMappings ),
+    m_linkedGeneration( 0 ) {
+  if( deferChannelAllocation ) m_channelManager.deferAllocation();
+}
 
 InternalSegmentMapper::~InternalSegmentMapper() {
   if( m_triggeredEvents ) { delete m_triggeredEvents; }
@@ -90,184 +98,116 @@ void InternalSegmentMapper::fillBuffer() {
 
   // Clear out stuff from before.
   m_triggeredEvents->clear();
+  m_triggerExpansionCache.clear();
   m_controllerCache.clear();
   m_noteOffs = NoteoffContainer();
 
+  // Every time thru a repeating segment maps the same events, just
+  // later, and so does every link of a linked segment.  So we walk
+  // the segment once and remember what we mapped, or take what a
+  // link of ours remembered, and replay it for each repeat.
+  LinkedSegmentMapping::Items        ownItems;
+  const LinkedSegmentMapping::Items *items         = &ownItems;
+  timeT                              linkOffset    = 0;
+  int                                linkTranspose = 0;
+
+  if( m_linkedMappings && m_segment->getLinker() &&
+      getInstrument() ) {
+    if( !m_linkedMapping ||
+        !m_linkedMapping->isFor( m_segment->getLinker(),
+                                 getInstrument() ) ) {
+      m_linkedMapping = m_linkedMappings->get(
+          m_segment->getLinker(), getInstrument() );
+      m_linkedGeneration = 0;
+    }
+  } else {
+    m_linkedMapping.reset();
+  }
+
+  // Links mapped on other threads wait for us to finish with the
+  // mapping, and then replay it.
+  std::unique_lock<std::mutex> linkedLock;
+  if( m_linkedMapping )
+    linkedLock =
+        std::unique_lock<std::mutex>( m_linkedMapping->getMutex() );
+
+  // If we have already replayed this mapping, we are being asked
+  // to map again because something changed, maybe something the
+  // mapping can't notice.  So we map ourselves and share that.
+  if( m_linkedMapping && m_linkedMapping->getSource() != m_segment &&
+      m_linkedMapping->getGeneration() != m_linkedGeneration &&
+      m_linkedMapping->canReplay( *m_segment ) ) {
+    items         = &m_linkedMapping->getItems();
+    linkOffset    = m_linkedMapping->getTimeOffset( *m_segment );
+    linkTranspose = m_linkedMapping->getTranspose( *m_segment );
+    m_linkedGeneration = m_linkedMapping->getGeneration();
+    m_linkedMapping->addUser( m_segment );
+
+    // getControllerValue() looks for ornament controllers here.
+    const std::vector<Event *> &controllers =
+        m_linkedMapping->getTriggeredControllers();
+    for( size_t i = 0; i < controllers.size(); ++i )
+      m_triggeredEvents->insert(
+          controllers[i]->copyMoving( linkOffset ) );
+
+    int spaceNeeded = addSize( calculateSize(), m_triggeredEvents );
+    if( spaceNeeded > capacity() ) reserve( spaceNeeded );
+  } else {
+    mapOneTimeThru( ownItems, comp, track );
+    if( m_linkedMapping &&
+        LinkedSegmentMapping::isShareable( *m_segment ) ) {
+      m_linkedMapping->set( m_segment, ownItems,
+                            *m_triggeredEvents );
+      m_linkedGeneration = m_linkedMapping->getGeneration();
+      items              = &m_linkedMapping->getItems();
+    }
+  }
+
+  // Noteoffs are merged in just as if we were walking the segment
+  // each time thru, and clipped to repeatEndTime the same way.
+  // Tempo may differ between repeats, so the real times are worked
+  // out for each.
   for( int repeatNo = 0; repeatNo <= repeatCount; ++repeatNo ) {
-    // For triggered segments.  We write their notes into
-    // *m_triggeredEvents and then process those notes at their
-    // appropriate times.  implied iterates over
-    // *m_triggeredEvents.
-    Segment::iterator implied = m_triggeredEvents->begin();
     // The delay in performance time due to which repeat we are
     // on.  Eg, on the second time thru we play everything one
     // segment duration later and so forth.
-    timeT timeForRepeats = repeatNo * segmentDuration;
-
-    for( Segment::iterator j = m_segment->begin();
-         m_segment->isBeforeEndMarker( j ) ||
-         ( implied != m_triggeredEvents->end() );
-         // No step here.  We'll step the appropriate iterator
-         // later in the loop.
-    ) {
-      bool usingImplied = false;
-      // timeT of the best candidate, treated as if the first
-      // time thru.  Timing for repeats will be handled later.
-      timeT bestBaseTime = std::numeric_limits<int>::max();
-
-      // Consider the earliest unprocessed "normal" event.
-      if( m_segment->isBeforeEndMarker( j ) ) {
-        bestBaseTime = ( *j )->getAbsoluteTime();
-      }
+    timeT timeForRepeats = repeatNo * segmentDuration + linkOffset;
 
-      // k is a pointer to the note iterator we will actually
-      // use.  Initialize it to the default of the segment's
-      // own.
-      Segment::iterator *k = &j;
-
-      // Now consider triggered events (again the earliest
-      // unprocessed one).  Break ties in favor of "real" notes.
-      if( implied != m_triggeredEvents->end() &&
-          ( !m_segment->isBeforeEndMarker( j ) ||
-            ( *implied )->getAbsoluteTime() < bestBaseTime ) ) {
-        k            = &implied;
-        usingImplied = true;
-        bestBaseTime = ( *implied )->getAbsoluteTime();
-      }
+    for( size_t i = 0; i < items->size(); ++i ) {
+      const LinkedSegmentMapping::Item &item = ( *items )[i];
 
       // If the earlier event now is a noteoff, use it.  We
       // compare to the performance time since noteoffs already
       // take repeat-times into count.
-      if( haveEarlierNoteoff( bestBaseTime + timeForRepeats ) ) {
+      while( haveEarlierNoteoff( item.baseTime + timeForRepeats ) )
         popInsertNoteoff( track->getId(), comp );
-        continue;
-      }
 
-      // We handle nested ornament expansion elsewhere, so
-      // trigger events won't be found in implied.
-      if( !usingImplied ) {
-        long triggerId = -1;
-        ( **k )->get<Int>( BaseProperties::TRIGGER_SEGMENT_ID,
-                           triggerId );
-
-        if( triggerId >= 0 ) {
-          TriggerSegmentRec *rec =
-              comp.getTriggerSegmentRec( triggerId );
-          // We will invalidate `implied' so we arrange to
-          // re-find it later.  Since we're always treating
-          // a normal note here, we always use the findTime
-          // method.
-          timeT refTime = ( *j )->getAbsoluteTime();
-          ControllerContextParams params(
-              refTime, getInstrument(), m_segment,
-              m_triggeredEvents, m_controllerCache, nullptr );
-
-          // Add triggered events into m_triggeredEvents.
-          // This invalidates `implied'.
-          bool insertedSomething =
-              rec && rec->ExpandInto( m_triggeredEvents, j,
-                                      m_segment, &params );
-          if( insertedSomething ) {
-            // Re-find `implied'
-            implied = Segment::iterator(
-                m_triggeredEvents->findTime( refTime ) );
-
-            // Recalculate how much buffer space to
-            // reserve.  !!! Probably should calculate the
-            // extra from m_triggeredEvents rather than
-            // rec->getSegment()
-            int spaceNeeded =
-                addSize( calculateSize(), rec->getSegment() );
-            // Reserve more space if we will need it.
-            if( spaceNeeded > capacity() ) {
-              reserve( spaceNeeded );
-            }
-          }
-
-          // whatever happens, we don't want to write this one
-          ++j;
-
-          // Since we're no longer sure what the next event
-          // is, restart the loop.
-          continue;
-        }
-      }
-
-      // Ignore rests
-      //
-      if( !( **k )->isa( Note::EventRestType ) ) {
-        SegmentPerformanceHelper helper(
-            usingImplied ? *m_triggeredEvents : *m_segment );
-
-        timeT playTime = helper.getSoundingAbsoluteTime( *k ) +
-                         timeForRepeats;
-        if( playTime >= repeatEndTime ) break;
-
-        timeT playDuration = helper.getSoundingDuration( *k );
-
-        // Ignore notes without duration -- they're probably in a
-        // tied series but not as first note
-        //
-        if( playDuration > 0 ||
-            !( **k )->isa( Note::EventType ) ) {
-          if( playTime + playDuration > repeatEndTime )
-            playDuration = repeatEndTime - playTime;
-
-          playTime = playTime + m_segment->getDelay();
-          const RealTime eventTime =
-              toRealTime( comp, playTime );
-
-          // slightly quicker than calling
-          // helper.getRealSoundingDuration()
-          RealTime endTime =
-              toRealTime( comp, playTime + playDuration );
-          const RealTime duration = endTime - eventTime;
-
-          try {
-            // Create mapped event and put it in buffer.
-            // The instrument will be set later by
-            // ChannelManager, so we set it to zero here.
-            MappedEvent e( 0,
-                           ***k, // three stars! what an accolade
-                           eventTime, duration );
-
-            // Somewhat hacky: The MappedEvent ctor makes
-            // events that needn't be inserted invalid.
-            if( e.isValid() ) {
-              e.setTrackId( track->getId() );
-
-              if( ( **k )->isa( Controller::EventType ) ||
-                  ( **k )->isa( PitchBend::EventType ) ) {
-                m_controllerCache.storeLatestValue( ( **k ) );
-              }
-
-              if( ( **k )->isa( Note::EventType ) ) {
-                if( m_segment->getTranspose() != 0 ) {
-                  e.setPitch( e.getPitch() +
-                              m_segment->getTranspose() );
-                }
-                if( e.getType() !=
-                    MappedEvent::MidiNoteOneShot ) {
-                  enqueueNoteoff( playTime + playDuration,
-                                  e.getPitch() );
-                }
-              }
-              mapAnEvent( &e );
-            } else {
-            }
-
-          } catch( ... ) {
-#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
-            SEQMAN_DEBUG << "SegmentMapper::fillBuffer - caught "
-                            "exception while trying to create "
-                            "MappedEvent\n";
-#endif
-          }
-        }
+      timeT playTime = item.soundingTime + timeForRepeats;
+      if( playTime >= repeatEndTime ) break;
+
+      timeT playDuration = item.playDuration;
+      if( playTime + playDuration > repeatEndTime )
+        playDuration = repeatEndTime - playTime;
+
+      playTime = playTime + m_segment->getDelay();
+      const RealTime eventTime = toRealTime( comp, playTime );
+
+      // slightly quicker than calling
+      // helper.getRealSoundingDuration()
+      RealTime endTime =
+          toRealTime( comp, playTime + playDuration );
+
+      MappedEvent e( item.event );
+      e.setTrackId( track->getId() );
+      e.setEventTime( eventTime );
+      e.setDuration( endTime - eventTime );
+      if( item.isNote ) {
+        int transpose = m_segment->getTranspose() + linkTranspose;
+        if( transpose != 0 ) e.setPitch( e.getPitch() + transpose );
+        if( item.needsNoteoff )
+          enqueueNoteoff( playTime + playDuration, e.getPitch() );
       }
-
-      ++*k; // increment either i or j, whichever one we just
-            // used
+      mapAnEvent( &e );
     }
   }
 
@@ -324,6 +264,163 @@ void InternalSegmentMapper::fillBuffer() {
   setStartEnd( minRealTime, maxRealTime );
 }
 
+void InternalSegmentMapper::mapOneTimeThru(
+    LinkedSegmentMapping::Items &items, Composition &comp,
+    Track *track ) {
+  // The segment's own events are looked up in m_soundingIndex.
+  // Triggered events are added as we go, so they aren't indexed.
+  SegmentPerformanceHelper impliedHelper( *m_triggeredEvents );
+
+  // For triggered segments.  We write their notes into
+  // *m_triggeredEvents and then process those notes at their
+  // appropriate times.  implied iterates over
+  // *m_triggeredEvents.
+  Segment::iterator implied = m_triggeredEvents->begin();
+
+  for( Segment::iterator j = m_segment->begin();
+       m_segment->isBeforeEndMarker( j ) ||
+       ( implied != m_triggeredEvents->end() );
+       // No step here.  We'll step the appropriate iterator
+       // later in the loop.
+  ) {
+    bool usingImplied = false;
+    // timeT of the best candidate, treated as if the first
+    // time thru.  Timing for repeats will be handled later.
+    timeT bestBaseTime = std::numeric_limits<int>::max();
+
+    // Consider the earliest unprocessed "normal" event.
+    if( m_segment->isBeforeEndMarker( j ) ) {
+      bestBaseTime = ( *j )->getAbsoluteTime();
+    }
+
+    // k is a pointer to the note iterator we will actually
+    // use.  Initialize it to the default of the segment's
+    // own.
+    Segment::iterator *k = &j;
+
+    // Now consider triggered events (again the earliest
+    // unprocessed one).  Break ties in favor of "real" notes.
+    if( implied != m_triggeredEvents->end() &&
+        ( !m_segment->isBeforeEndMarker( j ) ||
+          ( *implied )->getAbsoluteTime() < bestBaseTime ) ) {
+      k            = &implied;
+      usingImplied = true;
+      bestBaseTime = ( *implied )->getAbsoluteTime();
+    }
+
+    // We handle nested ornament expansion elsewhere, so
+    // trigger events won't be found in implied.
+    if( !usingImplied ) {
+      long triggerId = -1;
+      ( **k )->get<Int>( BaseProperties::TRIGGER_SEGMENT_ID,
+                         triggerId );
+
+      if( triggerId >= 0 ) {
+        TriggerSegmentRec *rec =
+            comp.getTriggerSegmentRec( triggerId );
+        // We will invalidate `implied' so we arrange to
+        // re-find it later.  Since we're always treating
+        // a normal note here, we always use the findTime
+        // method.
+        timeT refTime = ( *j )->getAbsoluteTime();
+        ControllerContextParams params(
+            refTime, getInstrument(), m_segment,
+            m_triggeredEvents, m_controllerCache, nullptr );
+
+        // Add triggered events into m_triggeredEvents.
+        // This invalidates `implied'.
+        bool insertedSomething =
+            rec && rec->ExpandInto( m_triggeredEvents, j,
+                                    m_segment, &params,
+                                    &m_triggerExpansionCache );
+        if( insertedSomething ) {
+          // Re-find `implied'
+          implied = Segment::iterator(
+              m_triggeredEvents->findTime( refTime ) );
+
+          // Recalculate how much buffer space to
+          // reserve.  !!! Probably should calculate the
+          // extra from m_triggeredEvents rather than
+          // rec->getSegment()
+          int spaceNeeded =
+              addSize( calculateSize(), rec->getSegment() );
+          // Reserve more space if we will need it.
+          if( spaceNeeded > capacity() ) {
+            reserve( spaceNeeded );
+          }
+        }
+
+        // whatever happens, we don't want to write this one
+        ++j;
+
+        // Since we're no longer sure what the next event
+        // is, restart the loop.
+        continue;
+      }
+    }
+
+    // Ignore rests
+    //
+    if( !( **k )->isa( Note::EventRestType ) ) {
+      timeT soundingTime, playDuration;
+      if( usingImplied ) {
+        soundingTime = impliedHelper.getSoundingAbsoluteTime( *k );
+        playDuration = impliedHelper.getSoundingDuration( *k );
+      } else {
+        soundingTime =
+            m_soundingIndex.getSoundingAbsoluteTime( **k );
+        playDuration = m_soundingIndex.getSoundingDuration( **k );
+      }
+
+      // Ignore notes without duration -- they're probably in a
+      // tied series but not as first note
+      //
+      if( playDuration > 0 || !( **k )->isa( Note::EventType ) ) {
+        try {
+          // Create mapped event.  The instrument will be set
+          // later by ChannelManager, so we set it to zero here.
+          // The times are set when it is played.
+          MappedEvent e( 0,
+                         ***k, // three stars! what an accolade
+                         RealTime::zeroTime, RealTime::zeroTime );
+
+          // Somewhat hacky: The MappedEvent ctor makes
+          // events that needn't be inserted invalid.
+          if( e.isValid() ) {
+            e.setTrackId( track->getId() );
+
+            if( ( **k )->isa( Controller::EventType ) ||
+                ( **k )->isa( PitchBend::EventType ) ) {
+              m_controllerCache.storeLatestValue( ( **k ) );
+            }
+
+            bool isNote = ( **k )->isa( Note::EventType );
+            LinkedSegmentMapping::Item item = {
+                e,
+                bestBaseTime,
+                soundingTime,
+                playDuration,
+                isNote,
+                isNote && e.getType() != MappedEvent::MidiNoteOneShot,
+                usingImplied };
+            items.push_back( item );
+          }
+
+        } catch( ... ) {
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+          SEQMAN_DEBUG << "SegmentMapper::fillBuffer - caught "
+                          "exception while trying to create "
+                          "MappedEvent\n";
+#endif
+        }
+      }
+    }
+
+    ++*k; // increment either i or j, whichever one we just
+          // used
+  }
+}
+
 /** Functions about the noteoff queue **/
 
 bool InternalSegmentMapper::haveEarlierNoteoff( timeT t ) {
@@ -389,7 +486,7 @@ void InternalSegmentMapper::makeReady(
 }
 
 void InternalSegmentMapper::insertChannelSetup(
-    MappedInserterBase &inserter ) {
+    MappedInserterBase &inserter, RealTime time ) {
   Instrument *instrument = m_doc->getInstrument( m_segment );
 
   // If this segment's Instrument is in Auto channels mode, bail.
@@ -397,9 +494,8 @@ void InternalSegmentMapper::insertChannelSetup(
 
   m_channelManager.setInstrument( instrument );
   m_channelManager.insertChannelSetup(
-      m_segment->getTrack(), RealTime::zeroTime,
-      getControllers( instrument, RealTime::zeroTime ),
-      inserter );
+      m_segment->getTrack(), time,
+      getControllers( instrument, time ), inserter );
 }
 
 void InternalSegmentMapper::doInsert(
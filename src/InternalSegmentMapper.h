@@ -19,10 +19,14 @@
 #define RG_INTERNALSEGMENTMAPPER_H
 
 #include "ControllerContext.h"
+#include "LinkedSegmentMapping.h"
 #include "MappedEventBuffer.h"
 #include "SegmentMapper.h"
+#include "SegmentSoundingIndex.h"
+#include "TriggerSegment.h"
 #include "ChannelManager.h"
 
+#include <memory>
 #include <set>
 
 namespace Rosegarden
@@ -30,6 +34,7 @@ namespace Rosegarden
 
 class TriggerSegmentRec;
 class Composition;
+class Track;
 struct RealTime;
  
 /// Converts (maps) Event objects into MappedEvent objects for a Segment
@@ -58,9 +63,23 @@ struct RealTime;
 class InternalSegmentMapper : public SegmentMapper
 {
 public:
-    InternalSegmentMapper(RosegardenDocument *doc, Segment *segment);
+    /**
+     * If segment is linked, its mapping is shared thru linkedMappings
+     * with its links'.  Not if that is null.
+     *
+     * If deferChannelAllocation, the channel is not allocated when the
+     * segment is mapped; see ChannelManager::deferAllocation().
+     */
+    InternalSegmentMapper(
+        RosegardenDocument *doc, Segment *segment,
+        std::shared_ptr<LinkedSegmentMappings> linkedMappings =
+            std::shared_ptr<LinkedSegmentMappings>(),
+        bool deferChannelAllocation = false);
     ~InternalSegmentMapper() override;
 
+    ChannelManager *getChannelManager() override
+    { return &m_channelManager; }
+
 private:
     // Hide copy ctor and op= since dtor is non-trivial.
     InternalSegmentMapper(const InternalSegmentMapper &);
@@ -95,8 +114,9 @@ private:
     // Do channel-setup for Auto channel mode.
     void makeReady(MappedInserterBase &inserter, RealTime time) override;
 
-    // Do channel-setup for Fixed channel mode.
-    void insertChannelSetup(MappedInserterBase &) override;
+    // Do channel-setup for Fixed channel mode, as of time.
+    void insertChannelSetup(MappedInserterBase &inserter,
+                            RealTime time) override;
 
     // Insert the event "evt"
     void doInsert(MappedInserterBase &inserter, MappedEvent &evt,
@@ -112,6 +132,10 @@ private:
     /// dump all segment data in the file
     void fillBuffer() override;
 
+    /// Map the segment once thru, without times, into items.
+    void mapOneTimeThru(LinkedSegmentMapping::Items &items,
+                        Composition &comp, Track *track);
+
     Instrument *getInstrument() const
     { return m_channelManager.getInstrument(); }
 
@@ -132,9 +156,23 @@ private:
     // original segment, contains just one time thru; logic in "fillBuffer"
     // turns it into repeats as needed.
     Segment               *m_triggeredEvents;
+
+    // Sounding times and durations of the segment's own events,
+    // with ties resolved.
+    SegmentSoundingIndex   m_soundingIndex;
+
+    // Ornament expansions already made this fillBuffer, for reuse
+    // by later triggers of the same ornament.
+    TriggerExpansionCache  m_triggerExpansionCache;
     
     ControllerContextMap   m_controllerCache;
 
+    // Mapping shared with the segment's links, if it has any, and
+    // which of its generations we last replayed.
+    std::shared_ptr<LinkedSegmentMappings> m_linkedMappings;
+    std::shared_ptr<LinkedSegmentMapping> m_linkedMapping;
+    unsigned int           m_linkedGeneration;
+
     // Queue of noteoffs.
     NoteoffContainer       m_noteOffs;
 };
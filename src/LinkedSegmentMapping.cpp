@@ -0,0 +1,173 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8
+ * sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.  See
+   the file COPYING included with this distribution for more
+   information.
+*/
+
+#include "LinkedSegmentMapping.h"
+
+#include "BaseProperties.h"
+#include "Event.h"
+#include "MidiTypes.h"
+#include "SegmentLinker.h"
+
+namespace Rosegarden {
+
+std::shared_ptr<LinkedSegmentMapping> LinkedSegmentMappings::get(
+    const SegmentLinker *linker, const Instrument *instrument ) {
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  // Forget the mappings nobody holds any more.  Their linkers may
+  // be gone and their addresses reused.
+  for( Mappings::iterator i = m_mappings.begin();
+       i != m_mappings.end(); ) {
+    if( i->second.expired() )
+      m_mappings.erase( i++ );
+    else
+      ++i;
+  }
+
+  std::weak_ptr<LinkedSegmentMapping> &entry =
+      m_mappings[Key( linker, instrument )];
+  std::shared_ptr<LinkedSegmentMapping> mapping = entry.lock();
+  if( !mapping ) {
+    mapping = std::shared_ptr<LinkedSegmentMapping>(
+        new LinkedSegmentMapping );
+    mapping->m_linker     = linker;
+    mapping->m_instrument = instrument;
+    entry                 = mapping;
+  }
+  return mapping;
+}
+
+LinkedSegmentMapping::LinkedSegmentMapping()
+  : m_source( nullptr ),
+    m_valid( false ),
+    m_linker( nullptr ),
+    m_instrument( nullptr ),
+    m_generation( 0 ),
+    m_sourceStartTime( 0 ),
+    m_sourceDuration( 0 ),
+    m_sourceSemitones( 0 ),
+    m_hasTriggeredNotes( false ) {}
+
+LinkedSegmentMapping::~LinkedSegmentMapping() {
+  for( std::set<Segment *>::iterator i = m_observed.begin();
+       i != m_observed.end(); ++i )
+    ( *i )->removeObserver( this );
+  clearTriggeredControllers();
+}
+
+void LinkedSegmentMapping::segmentDeleted( const Segment *segment ) {
+  // Don't call removeObserver() here: the Segment is iterating
+  // over its observer list, which dies with it anyway.
+  m_observed.erase( const_cast<Segment *>( segment ) );
+  if( segment == m_source ) {
+    m_source = nullptr;
+    m_valid  = false;
+  }
+}
+
+void LinkedSegmentMapping::invalidate() {
+  // We may be called while a Segment is notifying its observers,
+  // so keep observing it.
+  m_valid = false;
+}
+
+void LinkedSegmentMapping::observe( Segment *segment ) {
+  if( m_observed.insert( segment ).second )
+    segment->addObserver( this );
+}
+
+void LinkedSegmentMapping::addUser( Segment *segment ) {
+  observe( segment );
+}
+
+void LinkedSegmentMapping::clearTriggeredControllers() {
+  for( size_t i = 0; i < m_triggeredControllers.size(); ++i )
+    delete m_triggeredControllers[i];
+  m_triggeredControllers.clear();
+}
+
+int LinkedSegmentMapping::getTranspose(
+    const Segment &segment ) const {
+  return segment.getLinkTransposeParams().m_semitones -
+         m_sourceSemitones;
+}
+
+bool LinkedSegmentMapping::isShareable( const Segment &segment ) {
+  if( !segment.getLinker() ) return false;
+
+  // Events the linker ignores may differ from link to link.
+  for( Segment::const_iterator i = segment.begin();
+       i != segment.end(); ++i ) {
+    bool ignore = false;
+    if( ( *i )->get<Bool>(
+            BaseProperties::LINKED_SEGMENT_IGNORE_UPDATE,
+            ignore ) &&
+        ignore )
+      return false;
+  }
+  return true;
+}
+
+bool LinkedSegmentMapping::canReplay(
+    const Segment &segment ) const {
+  if( !isValid() ) return false;
+  if( segment.getLinker() != m_linker ||
+      m_source->getLinker() != m_linker )
+    return false;
+  if( segment.getEndMarkerTime() - segment.getStartTime() !=
+      m_sourceDuration )
+    return false;
+  if( m_hasTriggeredNotes && getTranspose( segment ) != 0 )
+    return false;
+  return isShareable( segment );
+}
+
+void LinkedSegmentMapping::set( Segment *source, Items &items,
+                                const Segment &triggeredEvents ) {
+  // The old source, if any, stays observed: it is still a link.
+  observe( source );
+  m_source = source;
+  m_valid  = true;
+  ++m_generation;
+
+  m_sourceStartTime = source->getStartTime();
+  m_sourceDuration =
+      source->getEndMarkerTime() - source->getStartTime();
+  m_sourceSemitones =
+      source->getLinkTransposeParams().m_semitones;
+
+  m_items.swap( items );
+  items.clear();
+
+  m_hasTriggeredNotes = false;
+  for( size_t i = 0; i < m_items.size(); ++i ) {
+    if( m_items[i].triggered && m_items[i].isNote ) {
+      m_hasTriggeredNotes = true;
+      break;
+    }
+  }
+
+  clearTriggeredControllers();
+  for( Segment::const_iterator i = triggeredEvents.begin();
+       i != triggeredEvents.end(); ++i ) {
+    if( ( *i )->isa( Controller::EventType ) ||
+        ( *i )->isa( PitchBend::EventType ) )
+      m_triggeredControllers.push_back( new Event( **i ) );
+  }
+}
+
+} // namespace Rosegarden
@@ -0,0 +1,208 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_LINKED_SEGMENT_MAPPING_H
+#define RG_LINKED_SEGMENT_MAPPING_H
+
+#include "MappedEvent.h"
+#include "Segment.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace Rosegarden
+{
+
+class Instrument;
+class SegmentLinker;
+
+/// One time thru a Segment, mapped, and shared between its links.
+/**
+ * Segments linked by a SegmentLinker hold the same events, moved to
+ * their own start times and possibly transposed.  Rather than have
+ * the InternalSegmentMapper of every link map its own copy, the first
+ * one to map stores what it got here, relative to its Segment (the
+ * source), and the others replay it at their own start times and
+ * transpositions.
+ *
+ * A mapping is shared by the links of one SegmentLinker playing on
+ * the same Instrument, since ornament controllers depend on it.  See
+ * LinkedSegmentMappings::get().
+ *
+ * The mapping observes its source and every link that replays it, and
+ * becomes invalid when any of them changes: the linker keeps links
+ * the same, so one changing means they all have.  Changes to trigger
+ * segments are not noticed, so a mapper that is asked to map again
+ * having already used the mapping should map its own Segment and set()
+ * the result.
+ *
+ * Mappers of links on different threads must hold getMutex() while
+ * they use the mapping.
+ */
+class LinkedSegmentMapping : public SegmentObserver
+{
+public:
+    /// An event mapped from the source, before any time is applied.
+    struct Item
+    {
+        // Event and track ID are set; times and segment transpose
+        // are not.
+        MappedEvent event;
+        // Time of the event the item was mapped from
+        timeT baseTime;
+        // Sounding time and duration, before any clipping
+        timeT soundingTime;
+        timeT playDuration;
+        bool isNote;
+        bool needsNoteoff;
+        // Whether this came from an ornament rather than the Segment
+        bool triggered;
+    };
+    typedef std::vector<Item> Items;
+
+    ~LinkedSegmentMapping() override;
+
+    /// Whether this is the mapping get() returns for these.
+    bool isFor(const SegmentLinker *linker,
+               const Instrument *instrument) const
+        { return linker == m_linker && instrument == m_instrument; }
+
+    bool isValid() const { return m_source && m_valid; }
+
+    /// Changes whenever set() is called.
+    unsigned int getGeneration() const { return m_generation; }
+
+    std::mutex &getMutex() { return m_mutex; }
+
+    Segment *getSource() const { return m_source; }
+
+    /// Whether segment can replay this mapping.
+    /**
+     * The mapping must be valid, and segment linked to the source, as
+     * long, and with no events that the linker ignores.  Ornament notes
+     * are only transposed with their trigger when retuned, so a mapping
+     * with any can't be replayed at another transposition.
+     */
+    bool canReplay(const Segment &segment) const;
+
+    /// Note that segment replays this mapping.
+    /**
+     * It is observed from then on, so that a change to it invalidates
+     * the mapping as a change to the source does.
+     */
+    void addUser(Segment *segment);
+
+    /// Whether segment's mapping can be shared at all.
+    static bool isShareable(const Segment &segment);
+
+    /// Replace the mapping with source's.  Takes items.
+    /**
+     * triggeredEvents are the ornament events expanded while mapping
+     * source; the controllers among them are kept, for
+     * getTriggeredControllers().
+     */
+    void set(Segment *source, Items &items,
+             const Segment &triggeredEvents);
+
+    const Items &getItems() const { return m_items; }
+
+    /// How far segment plays later than the source.
+    timeT getTimeOffset(const Segment &segment) const
+        { return segment.getStartTime() - m_sourceStartTime; }
+
+    /// How much segment is transposed against the source by its link.
+    int getTranspose(const Segment &segment) const;
+
+    /// Ornament controllers and pitch bends, at the source's times.
+    const std::vector<Event *> &getTriggeredControllers() const
+        { return m_triggeredControllers; }
+
+    // SegmentObserver overrides
+    void eventAdded(const Segment *, Event *) override { invalidate(); }
+    void eventRemoved(const Segment *, Event *) override { invalidate(); }
+    void allEventsChanged(const Segment *) override { invalidate(); }
+    void startChanged(const Segment *, timeT) override { invalidate(); }
+    void endMarkerTimeChanged(const Segment *, bool) override
+        { invalidate(); }
+    void segmentDeleted(const Segment *) override;
+
+private:
+    friend class LinkedSegmentMappings;
+
+    LinkedSegmentMapping();
+    LinkedSegmentMapping(const LinkedSegmentMapping &);
+    LinkedSegmentMapping &operator=(const LinkedSegmentMapping &);
+
+    void invalidate();
+    void clearTriggeredControllers();
+    void observe(Segment *segment);
+
+    std::mutex m_mutex;
+
+    // The source and the links that replayed the mapping.
+    std::set<Segment *> m_observed;
+
+    Segment *m_source;
+    bool m_valid;
+    const SegmentLinker *m_linker;
+    const Instrument *m_instrument;
+    unsigned int m_generation;
+
+    timeT m_sourceStartTime;
+    timeT m_sourceDuration;
+    int m_sourceSemitones;
+    bool m_hasTriggeredNotes;
+
+    Items m_items;
+    std::vector<Event *> m_triggeredControllers;
+};
+
+/// The LinkedSegmentMapping objects of one CompositionMapper.
+/**
+ * Shared by the CompositionMapper and its InternalSegmentMappers, so
+ * that mappings last as long as the mappers that use them, and never
+ * match the linkers of another composition.  get() may be called from
+ * several threads at once.
+ */
+class LinkedSegmentMappings
+{
+public:
+    LinkedSegmentMappings() { }
+
+    /// The mapping shared by the links of linker on instrument.
+    /**
+     * Creates an empty, invalid one if there is none.
+     */
+    std::shared_ptr<LinkedSegmentMapping>
+    get(const SegmentLinker *linker, const Instrument *instrument);
+
+private:
+    LinkedSegmentMappings(const LinkedSegmentMappings &);
+    LinkedSegmentMappings &operator=(const LinkedSegmentMappings &);
+
+    typedef std::pair<const SegmentLinker *, const Instrument *> Key;
+    typedef std::map<Key, std::weak_ptr<LinkedSegmentMapping> > Mappings;
+
+    std::mutex m_mutex;
+    Mappings m_mappings;
+};
+
+}
+
+#endif
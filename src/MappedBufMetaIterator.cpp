@@ -141,25 +141,36 @@ void MappedBufMetaIterator::moveIteratorToTime(
 }
 
 void MappedBufMetaIterator::fetchFixedChannelSetup(
-    MappedInserterBase &inserter ) {
+    MappedInserterBase &inserter, const RealTime &time ) {
   // Tracks we've seen.
   std::set<TrackId> tracks;
 
-  // for each MappedEventBuffer/segment in m_segments
-  for( MappedSegments::iterator i = m_segments.begin();
-       i != m_segments.end(); ++i ) {
-    std::shared_ptr<MappedEventBuffer> mappedEventBuffer = *i;
+  // A track's controllers are chased in the segment that plays at
+  // time, so look at those first, then at the rest.
+  for( int pass = 0; pass < 2; ++pass ) {
+    // for each MappedEventBuffer/segment in m_segments
+    for( MappedSegments::iterator i = m_segments.begin();
+         i != m_segments.end(); ++i ) {
+      std::shared_ptr<MappedEventBuffer> mappedEventBuffer = *i;
+
+      if( pass == 0 ) {
+        RealTime start;
+        RealTime end;
+        mappedEventBuffer->getStartEnd( start, end );
+        if( start > time || end <= time ) continue;
+      }
 
-    TrackId trackID = mappedEventBuffer->getTrackID();
+      TrackId trackID = mappedEventBuffer->getTrackID();
 
-    // If we've already seen this track, try the next segment.
-    if( tracks.find( trackID ) != tracks.end() ) continue;
+      // If we've already seen this track, try the next segment.
+      if( tracks.find( trackID ) != tracks.end() ) continue;
 
-    tracks.insert( trackID );
+      tracks.insert( trackID );
 
-    // Insert channel setup if this track is in Fixed channel
-    // mode.
-    mappedEventBuffer->insertChannelSetup( inserter );
+      // Insert channel setup if this track is in Fixed channel
+      // mode.
+      mappedEventBuffer->insertChannelSetup( inserter, time );
+    }
   }
 }
 
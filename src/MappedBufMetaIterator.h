@@ -67,7 +67,12 @@ public:
     /// Delete all iterators and forget all segments
     void clear();
 
-    void fetchFixedChannelSetup(MappedInserterBase &inserter);
+    /// Set up the channels of tracks in Fixed channel mode.
+    /**
+     * With their state at time, as the segment playing then has it.
+     */
+    void fetchFixedChannelSetup(MappedInserterBase &inserter,
+                                const RealTime &time = RealTime::zeroTime);
 
     void jumpToTime(const RealTime &);
 
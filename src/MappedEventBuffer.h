@@ -211,7 +211,8 @@ public:
     }
 
     virtual TrackId getTrackID() const  { return UINT_MAX; }
-    virtual void insertChannelSetup(MappedInserterBase &)  { }
+    /// Set up a Fixed mode channel with its state at time.
+    virtual void insertChannelSetup(MappedInserterBase &, RealTime)  { }
 
     class iterator 
     {
@@ -24,11 +24,12 @@ class MappedEvent;
 
 /// Base class for the polymorphic event inserters.
 /**
- * There are three derivers:
+ * There are four derivers:
  *
  *   - MappedEventInserter for playback
  *   - SortingInserter for sorting events when generating standard MIDI files
  *   - MidiInserter for generating standard MIDI files
+ *   - FanOutInserter for feeding several of the others at once
  *
  * See each of the above for more details.
  *
@@ -18,6 +18,8 @@
 
 #include "MidiFile.h"
 
+#include "ByteSink.h"
+#include "Exception.h"
 #include "Midi.h"
 #include "MidiEvent.h"
 
@@ -33,13 +35,25 @@
 
 
 
+#include "ExcerptInserter.h"
+#include "FanOutInserter.h"
 #include "MappedBufMetaIterator.h"
+#include "MappedEvent.h"
 #include "MidiInserter.h"
 #include "SortingInserter.h"
+#include "SplitMidiInserter.h"
 
+#include <cstring>
 #include <fstream>
+#include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static const char MIDI_FILE_HEADER[]  = "MThd";
 static const char MIDI_TRACK_HEADER[] = "MTrk";
@@ -53,602 +67,498 @@ MidiFile::MidiFile()
     m_timingDivision( 0 ),
     m_fps( 0 ),
     m_subframes( 0 ),
-    m_fileSize( 0 ),
-    m_trackByteCount( 0 ),
-    m_decrementCount( false ),
-    m_bytesRead( 0 ) {}
+    m_readPos( nullptr ),
+    m_readEnd( nullptr ),
+    m_fileEnd( nullptr ),
+    m_noteOffAsNoteOn( false ) {}
 
 MidiFile::~MidiFile() {
   // Delete all the event objects.
-  // clearMidiComposition();
+  clearMidiComposition();
 }
 
-// long MidiFile::midiBytesToLong( const std::string &bytes ) {
-//  if( bytes.length() != 4 ) {
-//    RG_WARNING << "midiBytesToLong(): WARNING: Wrong length for
-//    "
-//                  "long data ("
-//               << bytes.length() << ", should be 4)";
-
-//    // TRANSLATOR: "long" is a C++ data type
-//    throw Exception( qstrtostr( QObject::tr(
-//        "Wrong length for long data in MIDI stream" ) ) );
-//  }
-
-//  long longRet =
-//      static_cast<long>( static_cast<MidiByte>( bytes[0] ) )
-//          << 24 |
-//      static_cast<long>( static_cast<MidiByte>( bytes[1] ) )
-//          << 16 |
-//      static_cast<long>( static_cast<MidiByte>( bytes[2] ) )
-//          << 8 |
-//      static_cast<long>( static_cast<MidiByte>( bytes[3] ) );
-
-//  RG_DEBUG
-//      << "midiBytesToLong("
-//      << static_cast<long>( static_cast<MidiByte>( bytes[0] ) )
-//      << ","
-//      << static_cast<long>( static_cast<MidiByte>( bytes[1] ) )
-//      << ","
-//      << static_cast<long>( static_cast<MidiByte>( bytes[2] ) )
-//      << ","
-//      << static_cast<long>( static_cast<MidiByte>( bytes[3] ) )
-//      << ") -> " << longRet;
-
-//  return longRet;
-//}
-
-// int MidiFile::midiBytesToInt( const std::string &bytes ) {
-//  if( bytes.length() != 2 ) {
-//    RG_WARNING << "midiBytesToInt(): WARNING: Wrong length for
-//    "
-//                  "int data ("
-//               << bytes.length() << ", should be 2)";
-
-//    // TRANSLATOR: "int" is a C++ data type
-//    throw Exception( qstrtostr( QObject::tr(
-//        "Wrong length for int data in MIDI stream" ) ) );
-//  }
-
-//  return static_cast<int>( static_cast<MidiByte>( bytes[0] ) )
-//             << 8 |
-//         static_cast<int>( static_cast<MidiByte>( bytes[1] ) );
-//}
-
-// MidiByte MidiFile::read( std::ifstream *midiFile ) {
-//  return static_cast<MidiByte>( read( midiFile, 1 )[0] );
-//}
-
-// std::string MidiFile::read( std::ifstream *midiFile,
-//                            unsigned long  numberOfBytes ) {
-//  if( midiFile->eof() ) {
-//    RG_WARNING << "read(): MIDI file EOF - got 0 bytes out of "
-//               << numberOfBytes;
-
-//    throw Exception( qstrtostr( QObject::tr(
-//        "End of MIDI file encountered while reading" ) ) );
-//  }
-
-//  // For each track section we can read only m_trackByteCount
-//  // bytes.
-//  if( m_decrementCount &&
-//      numberOfBytes >
-//          static_cast<unsigned long>( m_trackByteCount ) ) {
-//    RG_WARNING << "read(): Attempt to get more bytes than "
-//                  "allowed on Track ("
-//               << numberOfBytes << " > " << m_trackByteCount
-//               << ")";
-
-//    throw Exception( qstrtostr( QObject::tr(
-//        "Attempt to get more bytes than expected on Track" ) )
-//        );
-//  }
-
-//  char        fileMidiByte;
-//  std::string stringRet;
-
-//  // ??? Reading one byte at a time is terribly slow.  However,
-//  // this
-//  //     routine is usually called with numberOfBytes == 1.
-//  while( stringRet.length() < numberOfBytes &&
-//         midiFile->read( &fileMidiByte, 1 ) ) {
-//    stringRet += fileMidiByte;
-
-//    // Kick the event loop to make sure the UI doesn't become
-//    // unresponsive during a long load.
-//    qApp->processEvents();
-//  }
-
-//  // Unexpected EOF
-//  if( stringRet.length() < numberOfBytes ) {
-//    RG_WARNING << "read(): Attempt to read past file end - got
-//    "
-//               << stringRet.length() << " bytes out of "
-//               << numberOfBytes;
-
-//    throw Exception( qstrtostr(
-//        QObject::tr( "Attempt to read past MIDI file end" ) )
-//        );
-//  }
-
-//  if( m_decrementCount ) m_trackByteCount -= numberOfBytes;
-
-//  m_bytesRead += numberOfBytes;
-
-//  // Every 2000 bytes...
-//  if( m_bytesRead >= 2000 ) {
-//    m_bytesRead = 0;
-
-//    // Update the progress dialog if one is connected.
-//    if( m_progressDialog ) {
-//      if( m_progressDialog->wasCanceled() )
-//        throw Exception(
-//            qstrtostr( QObject::tr( "Cancelled by user" ) ) );
-
-//      // This is the first 20% of the "reading" process.
-//      int progressValue = static_cast<int>(
-//          static_cast<double>( midiFile->tellg() ) /
-//          static_cast<double>( m_fileSize ) * 20.0 );
-
-//      m_progressDialog->setValue( progressValue );
-//    }
-//  }
-
-//  return stringRet;
-//}
-
-// long MidiFile::readNumber( std::ifstream *midiFile,
-//                           int            firstByte ) {
-//  if( midiFile->eof() ) return 0;
-
-//  MidiByte midiByte;
-
-//  // If we already have the first byte, use it
-//  if( firstByte >= 0 ) {
-//    midiByte = static_cast<MidiByte>( firstByte );
-//  } else { // read it
-//    midiByte = read( midiFile );
-//  }
-
-//  long longRet = midiByte;
+namespace {
+
+// A file mapped into memory for reading.  Files that can't be
+// mapped, eg pipes, are read into a buffer instead.
+class MappedFile {
+public:
+  explicit MappedFile( const std::string& filename )
+    : m_data( nullptr ), m_size( 0 ), m_mapped( false ),
+      m_open( false ) {
+    // "-" is standard input, which is left open.
+    int fd = filename == "-" ? ::dup( STDIN_FILENO )
+                             : ::open( filename.c_str(), O_RDONLY );
+    if( fd < 0 ) return;
+
+    struct stat status;
+    if( ::fstat( fd, &status ) == 0 && S_ISREG( status.st_mode ) &&
+        status.st_size > 0 ) {
+      void* data = ::mmap( nullptr, status.st_size, PROT_READ,
+                           MAP_PRIVATE, fd, 0 );
+      if( data != MAP_FAILED ) {
+        ::madvise( data, status.st_size, MADV_SEQUENTIAL );
+        m_data   = static_cast<const MidiByte*>( data );
+        m_size   = status.st_size;
+        m_mapped = true;
+      }
+    }
 
-//  // See MIDI spec section 4, pages 2 and 11.
+    if( !m_mapped ) {
+      char    block[65536];
+      ssize_t count;
+      while( ( count = ::read( fd, block, sizeof( block ) ) ) > 0 )
+        m_buffer.append( block, count );
+      if( count < 0 ) {
+        ::close( fd );
+        return;
+      }
+      m_data = reinterpret_cast<const MidiByte*>( m_buffer.data() );
+      m_size = m_buffer.size();
+    }
 
-//  if( midiByte & 0x80 ) {
-//    longRet &= 0x7F;
-//    do {
-//      midiByte = read( midiFile );
-//      longRet  = ( longRet << 7 ) + ( midiByte & 0x7F );
-//    } while( !midiFile->eof() && ( midiByte & 0x80 ) );
-//  }
+    ::close( fd );
+    m_open = true;
+  }
 
-//  return longRet;
-//}
+  ~MappedFile() {
+    if( m_mapped )
+      ::munmap( const_cast<MidiByte*>( m_data ), m_size );
+  }
 
-// void MidiFile::findNextTrack( std::ifstream *midiFile ) {
-//  // Conforms to recommendation in the MIDI spec, section 4,
-//  page
-//  // 3: "Your programs should /expect/ alien chunks and treat
-//  // them as if they weren't there."  (Emphasis theirs.)
-
-//  // Assume not found.
-//  m_decrementCount = false;
-//  m_trackByteCount = -1;
-
-//  // For each chunk
-//  while( !midiFile->eof() ) {
-//    // Read the chunk type and size.
-//    std::string chunkType = read( midiFile, 4 );
-//    long chunkSize = midiBytesToLong( read( midiFile, 4 ) );
-
-//    // If we've found a track chunk
-//    if( chunkType.compare( 0, 4, MIDI_TRACK_HEADER ) == 0 ) {
-//      m_trackByteCount = chunkSize;
-//      m_decrementCount = true;
-//      return;
-//    }
+  bool            isOpen() const { return m_open; }
+  const MidiByte* begin() const { return m_data; }
+  const MidiByte* end() const { return m_data + m_size; }
+
+private:
+  MappedFile( const MappedFile& );
+  MappedFile& operator=( const MappedFile& );
+
+  const MidiByte* m_data;
+  size_t          m_size;
+  bool            m_mapped;
+  bool            m_open;
+  std::string     m_buffer;
+};
+
+// A note-on waiting for its note-off.
+struct PendingNote {
+  MidiEvent*    event;
+  unsigned long time;
+};
+
+// Add event, at absolute time, to the end of track, whose last
+// event was at lastTime.  The event's time becomes the delta.
+void appendEvent( MidiFile::MidiTrack& track,
+                  unsigned long& lastTime, unsigned long time,
+                  MidiEvent* event ) {
+  event->setTime( time - lastTime );
+  lastTime = time;
+  track.push_back( event );
+}
 
-//    RG_DEBUG << "findNextTrack(): skipping alien chunk.  Type:"
-//             << chunkType;
+// Give note the duration up to time.
+void endNote( const PendingNote& note, unsigned long time ) {
+  timeT noteDuration = time - note.time;
 
-//    // Alien chunk encountered, initiate evasive maneuvers
-//    (skip
-//    // it).
-//    midiFile->seekg( chunkSize, std::ios::cur );
-//  }
+  // Some MIDI files floating around in the real world apparently
+  // have note-on followed immediately by note-off on percussion
+  // tracks.  Instead of setting the duration to 0 in this case,
+  // which has no meaning, set it to 1.
+  if( noteDuration == 0 ) noteDuration = 1;
 
-//  // Track not found.
-//  RG_WARNING << "findNextTrack(): Couldn't find Track";
-//  throw Exception( qstrtostr( QObject::tr(
-//      "File corrupted or in non-standard format" ) ) );
-//}
+  note.event->setDuration( noteDuration );
+}
 
-// bool MidiFile::read( const QString &filename ) {
-//  RG_DEBUG << "read(): filename = " << filename;
+} // namespace
 
-//  clearMidiComposition();
+unsigned long MidiFile::midiBytesToLong( const MidiByte* bytes ) {
+  return static_cast<unsigned long>( bytes[0] ) << 24 |
+         static_cast<unsigned long>( bytes[1] ) << 16 |
+         static_cast<unsigned long>( bytes[2] ) << 8 |
+         static_cast<unsigned long>( bytes[3] );
+}
 
-//  // Open the file
-//  std::ifstream *midiFile = new std::ifstream(
-//      filename.toLocal8Bit(), std::ios::in | std::ios::binary
-//      );
+int MidiFile::midiBytesToInt( const MidiByte* bytes ) {
+  return static_cast<int>( bytes[0] ) << 8 |
+         static_cast<int>( bytes[1] );
+}
 
-//  if( !( *midiFile ) ) {
-//    m_error  = "File not found or not readable.";
-//    m_format = MIDI_FILE_NOT_LOADED;
-//    return false;
-//  }
+MidiByte MidiFile::read() {
+  // For each track section we can only read up to the end of the
+  // track.
+  if( m_readPos == m_readEnd )
+    throw Exception(
+        "Attempt to get more bytes than expected on Track" );
+  return *m_readPos++;
+}
 
-//  // Compute the file size so we can report progress.
-//  midiFile->seekg( 0, std::ios::end );
-//  m_fileSize = midiFile->tellg();
-//  midiFile->seekg( 0, std::ios::beg );
+std::string MidiFile::read( unsigned long numberOfBytes ) {
+  if( numberOfBytes >
+      static_cast<unsigned long>( m_readEnd - m_readPos ) )
+    throw Exception(
+        "Attempt to get more bytes than expected on Track" );
 
-//  // The parsing process throws string exceptions back up here
-//  if
-//  // we run into trouble which we can then pass back out to
-//  // whomever called us using m_error and a nice bool.
-//  try {
-//    // Parse the MIDI header first.
-//    parseHeader( midiFile );
+  std::string stringRet( reinterpret_cast<const char*>( m_readPos ),
+                         numberOfBytes );
+  m_readPos += numberOfBytes;
+  return stringRet;
+}
 
-//    // For each track chunk in the MIDI file.
-//    for( unsigned track = 0; track < m_numberOfTracks;
-//         ++track ) {
-//      RG_DEBUG << "read(): Parsing MIDI file track " << track;
+long MidiFile::readNumber( int firstByte ) {
+  // If we already have the first byte, use it
+  MidiByte midiByte = ( firstByte >= 0 )
+                          ? static_cast<MidiByte>( firstByte )
+                          : read();
+
+  long longRet = midiByte & 0x7F;
+
+  // See MIDI spec section 4, pages 2 and 11.  A quantity is at
+  // most four bytes.
+  for( int length = 1; midiByte & 0x80; ++length ) {
+    if( length == 4 )
+      throw Exception( "Variable-length quantity too long" );
+    midiByte = read();
+    longRet  = ( longRet << 7 ) | ( midiByte & 0x7F );
+  }
 
-//      // Skip any alien chunks.
-//      findNextTrack( midiFile );
+  return longRet;
+}
 
-//      RG_DEBUG << "read(): Track has " << m_trackByteCount
-//               << " bytes";
+void MidiFile::findNextTrack() {
+  // Conforms to recommendation in the MIDI spec, section 4, page
+  // 3: "Your programs should /expect/ alien chunks and treat
+  // them as if they weren't there."  (Emphasis theirs.)
+  m_readEnd = m_fileEnd;
+
+  // For each chunk
+  while( m_fileEnd - m_readPos >= 8 ) {
+    // Read the chunk type and size.
+    const MidiByte* chunkType = m_readPos;
+    unsigned long   chunkSize = midiBytesToLong( m_readPos + 4 );
+    m_readPos += 8;
+
+    if( chunkSize >
+        static_cast<unsigned long>( m_fileEnd - m_readPos ) )
+      throw Exception( "Attempt to read past MIDI file end" );
+
+    // If we've found a track chunk
+    if( std::memcmp( chunkType, MIDI_TRACK_HEADER, 4 ) == 0 ) {
+      m_readEnd = m_readPos + chunkSize;
+      return;
+    }
 
-//      // Read the track into m_midiComposition.
-//      parseTrack( midiFile );
-//    }
+    // Alien chunk encountered, initiate evasive maneuvers (skip
+    // it).
+    m_readPos += chunkSize;
+  }
 
-//  } catch( const Exception &e ) {
-//    RG_WARNING << "read() - caught exception - "
-//               << e.getMessage();
+  // Track not found.
+  throw Exception( "File corrupted or in non-standard format" );
+}
 
-//    m_error  = e.getMessage();
-//    m_format = MIDI_FILE_NOT_LOADED;
-//    return false;
-//  }
+bool MidiFile::read( std::string const& filename ) {
+  clearMidiComposition();
 
-//  midiFile->close();
+  MappedFile midiFile( filename );
+  if( !midiFile.isOpen() ) {
+    m_error  = "File not found or not readable.";
+    m_format = MIDI_FILE_NOT_LOADED;
+    return false;
+  }
 
-//  return true;
-//}
+  m_readPos = midiFile.begin();
+  m_readEnd = m_fileEnd = midiFile.end();
 
-// void MidiFile::parseHeader( std::ifstream *midiFile ) {
-//  // The basic MIDI header is 14 bytes.
-//  std::string midiHeader = read( midiFile, 14 );
+  // The parsing process throws exceptions back up here if we run
+  // into trouble which we can then pass back out to whomever
+  // called us using m_error and a nice bool.
+  bool ok = true;
+  try {
+    // Parse the MIDI header first.
+    parseHeader();
 
-//  if( midiHeader.size() < 14 ) {
-//    RG_WARNING << "parseHeader() - file header undersized";
-//    throw Exception(
-//        qstrtostr( QObject::tr( "Not a MIDI file" ) ) );
-//  }
+    // For each track chunk in the MIDI file.
+    for( unsigned track = 0; track < m_numberOfTracks; ++track ) {
+      // Skip any alien chunks.
+      findNextTrack();
 
-//  if( midiHeader.compare( 0, 4, MIDI_FILE_HEADER ) != 0 ) {
-//    RG_WARNING
-//        << "parseHeader() - file header not found or
-//        malformed";
-//    throw Exception(
-//        qstrtostr( QObject::tr( "Not a MIDI file" ) ) );
-//  }
+      // Read the track into m_midiComposition.
+      parseTrack();
+    }
+  } catch( const Exception& e ) {
+    m_error  = e.getMessage();
+    m_format = MIDI_FILE_NOT_LOADED;
+    ok       = false;
+  }
 
-//  long chunkSize = midiBytesToLong( midiHeader.substr( 4, 4 )
-//  ); m_format       = static_cast<FileFormatType>(
-//      midiBytesToInt( midiHeader.substr( 8, 2 ) ) );
-//  m_numberOfTracks =
-//      midiBytesToInt( midiHeader.substr( 10, 2 ) );
-//  m_timingDivision =
-//      midiBytesToInt( midiHeader.substr( 12, 2 ) );
-//  m_timingFormat = MIDI_TIMING_PPQ_TIMEBASE;
-
-//  if( m_format == MIDI_SEQUENTIAL_TRACK_FILE ) {
-//    RG_WARNING << "parseHeader() - can't load sequential track
-//    "
-//                  "(Format 2) MIDI file";
-//    throw Exception( qstrtostr(
-//        QObject::tr( "Unexpected MIDI file format" ) ) );
-//  }
+  // The file is unmapped on return.
+  m_readPos = m_readEnd = m_fileEnd = nullptr;
 
-//  if( m_timingDivision > 32767 ) {
-//    RG_DEBUG << "parseHeader() - file uses SMPTE timing";
+  return ok;
+}
 
-//    m_timingFormat = MIDI_TIMING_SMPTE;
-//    m_fps          = 256 - ( m_timingDivision >> 8 );
-//    m_subframes    = ( m_timingDivision & 0xff );
-//  }
+void MidiFile::parseHeader() {
+  // The basic MIDI header is 14 bytes.
+  if( m_readEnd - m_readPos < 14 ||
+      std::memcmp( m_readPos, MIDI_FILE_HEADER, 4 ) != 0 )
+    throw Exception( "Not a MIDI file" );
+
+  unsigned long chunkSize = midiBytesToLong( m_readPos + 4 );
+  m_format                = static_cast<FileFormatType>(
+      midiBytesToInt( m_readPos + 8 ) );
+  m_numberOfTracks = midiBytesToInt( m_readPos + 10 );
+  m_timingDivision = midiBytesToInt( m_readPos + 12 );
+  m_timingFormat   = MIDI_TIMING_PPQ_TIMEBASE;
+
+  if( m_format == MIDI_SEQUENTIAL_TRACK_FILE )
+    throw Exception( "Unexpected MIDI file format" );
+
+  if( m_timingDivision > 32767 ) {
+    m_timingFormat = MIDI_TIMING_SMPTE;
+    m_fps          = 256 - ( m_timingDivision >> 8 );
+    m_subframes    = ( m_timingDivision & 0xff );
+  }
 
-//  if( chunkSize > 6 ) {
-//    // Skip any remaining bytes in the header chunk.
-//    // MIDI spec section 4, page 5: "[...] more parameters may
-//    be
-//    // added to the MThd chunk in the future: it is important
-//    to
-//    // read and honor the length, even if it is longer than 6."
-//    midiFile->seekg( chunkSize - 6, std::ios::cur );
-//  }
-//}
+  // Skip any remaining bytes in the header chunk.  MIDI spec
+  // section 4, page 5: "[...] more parameters may be added to the
+  // MThd chunk in the future: it is important to read and honor
+  // the length, even if it is longer than 6."
+  m_readPos += 8;
+  if( chunkSize < 6 ||
+      chunkSize >
+          static_cast<unsigned long>( m_readEnd - m_readPos ) )
+    throw Exception( "Not a MIDI file" );
+  m_readPos += chunkSize;
+}
 
-// static const std::string defaultTrackName = "Imported MIDI";
-
-// void MidiFile::parseTrack( std::ifstream *midiFile ) {
-//  // The term "Track" is overloaded in this routine.  The first
-//  // meaning is a track in the MIDI file.  That is what this
-//  // routine processes.  A single track from a MIDI file.  The
-//  // second meaning is a track in m_midiComposition.  This is
-//  the
-//  // most common usage. To improve clarity, "MIDI file track"
-//  // will be used to refer to the first sense of the term.
-//  // Occasionally, "m_midiComposition track" will be used to
-//  // refer to the second sense.
-
-//  // Absolute time of the last event on any track.
-//  unsigned long eventTime = 0;
-
-//  // lastTrackNum is the track for all events provided they're
-//  // all on the same channel.  If we find events on more than
-//  one
-//  // channel, we increment lastTrackNum and record the mapping
-//  // from channel to trackNum in channelToTrack.
-//  TrackId lastTrackNum = m_midiComposition.size();
-
-//  // MIDI channel to m_midiComposition track.
-//  // Note: This would be a vector<TrackId> but TrackId is
-//  // unsigned
-//  //       and we need -1 to indicate "not yet used"
-//  std::vector<int> channelToTrack( 16, -1 );
-
-//  // This is used to store the last absolute time found on each
-//  // track, allowing us to modify delta-times correctly when
-//  // separating events out from one to multiple tracks
-//  std::map<int [>track*/, unsigned long /*lastTime<]>
-//      lastEventTime;
-//  lastEventTime[lastTrackNum] = 0;
-
-//  // Meta-events don't have a channel, so we place them in a
-//  // fixed track number instead
-//  TrackId metaTrack = lastTrackNum;
-
-//  std::string trackName = defaultTrackName;
-//  std::string instrumentName;
-
-//  // Remember the last non-meta status byte (-1 if we haven't
-//  // seen one)
-//  int runningStatus = -1;
-
-//  bool firstTrack = true;
-
-//  RG_DEBUG << "parseTrack(): last track number is "
-//           << lastTrackNum;
-
-//  // While there is still data to read in the MIDI file track.
-//  // Why "m_trackByteCount > 1" instead of "m_trackByteCount >
-//  // 0"?  Since no event and its associated delta time can fit
-//  in
-//  // just one byte, a single remaining byte in the MIDI file
-//  // track has to be padding. This is obscure and non-standard,
-//  // but such files do exist; ordinarily there should be no
-//  bytes
-//  // in the MIDI file track after the last event.
-//  while( !midiFile->eof() && m_trackByteCount > 1 ) {
-//    unsigned long deltaTime = readNumber( midiFile );
-
-//    RG_DEBUG << "parseTrack(): read delta time " << deltaTime;
-
-//    // Compute the absolute time for the event.
-//    eventTime += deltaTime;
-
-//    // Get a single byte
-//    MidiByte midiByte = read( midiFile );
-
-//    MidiByte statusByte = 0;
-//    MidiByte data1      = 0;
-
-//    // If this is a status byte, use it.
-//    if( midiByte & MIDI_STATUS_BYTE_MASK ) {
-//      RG_DEBUG << "parseTrack(): have new status byte"
-//               << QString( "0x%1" ).arg( midiByte, 0, 16 );
-
-//      statusByte = midiByte;
-//      data1      = read( midiFile );
-//    } else { // Use running status.
-//      // If we haven't seen a status byte yet, fail.
-//      if( runningStatus < 0 )
-//        throw Exception( qstrtostr( QObject::tr(
-//            "Running status used for first event in track" ) )
-//            );
-
-//      statusByte = static_cast<MidiByte>( runningStatus );
-//      data1      = midiByte;
-
-//      RG_DEBUG << "parseTrack(): using running status (byte "
-//               << QString( "0x%1" ).arg( midiByte, 0, 16 )
-//               << " found)";
-//    }
+static const std::string defaultTrackName = "Imported MIDI";
+
+void MidiFile::parseTrack() {
+  // The term "Track" is overloaded in this routine.  The first
+  // meaning is a track in the MIDI file.  That is what this
+  // routine processes.  A single track from a MIDI file.  The
+  // second meaning is a track in m_midiComposition.  This is the
+  // most common usage. To improve clarity, "MIDI file track" will
+  // be used to refer to the first sense of the term.
+  // Occasionally, "m_midiComposition track" will be used to refer
+  // to the second sense.
+
+  // Absolute time of the last event on any track.
+  unsigned long eventTime = 0;
+
+  // Meta-events don't have a channel, so we place them in a fixed
+  // track number instead, which is also the track of the first
+  // channel we find.  If we find events on more than one channel,
+  // each further channel gets the next track number.
+  const TrackId metaTrack = m_midiComposition.size();
+  m_midiComposition[metaTrack];
+  TrackId lastTrackNum = metaTrack;
+
+  // MIDI channel to m_midiComposition track.
+  // Note: This would be a vector<TrackId> but TrackId is unsigned
+  //       and we need -1 to indicate "not yet used"
+  std::vector<int> channelToTrack( 16, -1 );
+
+  // The m_midiComposition tracks of this MIDI file track, by
+  // track number less metaTrack, with the absolute time of the
+  // last event on each, allowing us to compute delta-times
+  // correctly when separating events out from one to multiple
+  // tracks.
+  MidiTrack*    tracks[16];
+  unsigned long lastEventTime[16];
+  tracks[0]        = &m_midiComposition[metaTrack];
+  lastEventTime[0] = 0;
+
+  // Note-ons still sounding, by channel and pitch, earliest
+  // first.  Each note-off ends the earliest, and is then dropped.
+  std::vector<std::vector<PendingNote> > pendingNotes( 16 * 128 );
+
+  std::string trackName = defaultTrackName;
+  std::string instrumentName;
+
+  // Remember the last non-meta status byte (-1 if we haven't seen
+  // one)
+  int runningStatus = -1;
+
+  bool firstTrack = true;
+
+  // While there is still data to read in the MIDI file track.
+  // Why "> 1" instead of "> 0"?  Since no event and its
+  // associated delta time can fit in just one byte, a single
+  // remaining byte in the MIDI file track has to be padding. This
+  // is obscure and non-standard, but such files do exist;
+  // ordinarily there should be no bytes in the MIDI file track
+  // after the last event.
+  while( m_readEnd - m_readPos > 1 ) {
+    // Compute the absolute time for the event.
+    eventTime += readNumber();
+
+    // Get a single byte
+    MidiByte midiByte = read();
+
+    MidiByte statusByte = 0;
+    MidiByte data1      = 0;
+
+    // If this is a status byte, use it.
+    if( midiByte & MIDI_STATUS_BYTE_MASK ) {
+      statusByte = midiByte;
+      data1      = read();
+    } else { // Use running status.
+      // If we haven't seen a status byte yet, fail.
+      if( runningStatus < 0 )
+        throw Exception(
+            "Running status used for first event in track" );
+
+      statusByte = static_cast<MidiByte>( runningStatus );
+      data1      = midiByte;
+    }
 
-//    if( statusByte == MIDI_FILE_META_EVENT ) {
-//      MidiByte metaEventCode = data1;
-//      unsigned messageLength = readNumber( midiFile );
+    if( statusByte == MIDI_FILE_META_EVENT ) {
+      MidiByte    metaEventCode = data1;
+      std::string metaMessage   = read( readNumber() );
 
-//      RG_DEBUG << "parseTrack(): Meta event of type "
-//               << QString( "0x%1" ).arg( metaEventCode, 0, 16 )
-//               << " and " << messageLength << " bytes found";
+      appendEvent( *tracks[0], lastEventTime[0], eventTime,
+                   new MidiEvent( 0, MIDI_FILE_META_EVENT,
+                                  metaEventCode, metaMessage ) );
 
-//      std::string metaMessage = read( midiFile, messageLength
-//      );
+      if( metaEventCode == MIDI_TRACK_NAME )
+        trackName = metaMessage;
+      else if( metaEventCode == MIDI_INSTRUMENT_NAME )
+        instrumentName = metaMessage;
 
-//      // Compute the difference between this event and the
-//      // previous event on this track.
-//      deltaTime = eventTime - lastEventTime[metaTrack];
-//      // Store the absolute time of the last event on this
-//      track. lastEventTime[metaTrack] = eventTime;
+      // Get the next event.
+      continue;
+    }
 
-//      // create and store our event
-//      MidiEvent *e =
-//          new MidiEvent( deltaTime, MIDI_FILE_META_EVENT,
-//                         metaEventCode, metaMessage );
-//      m_midiComposition[metaTrack].push_back( e );
+    if( statusByte == MIDI_SYSTEM_EXCLUSIVE ||
+        statusByte == MIDI_END_OF_EXCLUSIVE ) {
+      // Sysex cancels running status.
+      runningStatus = -1;
 
-//      if( metaEventCode == MIDI_TRACK_NAME )
-//        trackName = metaMessage;
-//      else if( metaEventCode == MIDI_INSTRUMENT_NAME )
-//        instrumentName = metaMessage;
+      std::string sysex = read( readNumber( data1 ) );
 
-//      // Get the next event.
-//      continue;
-//    }
+      // Escaped bytes (F7) and sysex sent in packets don't fit
+      // in a MidiEvent; skip them.
+      if( statusByte == MIDI_END_OF_EXCLUSIVE || sysex.empty() ||
+          MidiByte( sysex[sysex.length() - 1] ) !=
+              MIDI_END_OF_EXCLUSIVE )
+        continue;
 
-//    runningStatus = statusByte;
-
-//    int channel = ( statusByte & MIDI_CHANNEL_NUM_MASK );
-
-//    // If this channel hasn't been seen yet in this MIDI file
-//    // track
-//    if( channelToTrack[channel] == -1 ) {
-//      // If this is the first m_midiComposition track we've
-//      // used
-//      if( firstTrack ) {
-//        // We've already allocated an m_midiComposition track
-//        for
-//        // the first channel we encounter.  Use it.
-//        firstTrack = false;
-//      } else { // We need a new track.
-//        // Allocate a new track for this channel.
-//        ++lastTrackNum;
-//        lastEventTime[lastTrackNum] = 0;
-//      }
+      // Chop off the EOX.
+      sysex.erase( sysex.length() - 1 );
 
-//      RG_DEBUG << "parseTrack(): new channel map entry: channel
-//      "
-//               << channel << " -> track " << lastTrackNum;
+      appendEvent(
+          *tracks[0], lastEventTime[0], eventTime,
+          new MidiEvent( 0, MIDI_SYSTEM_EXCLUSIVE, sysex ) );
+      continue;
+    }
 
-//      channelToTrack[channel]         = lastTrackNum;
-//      m_trackChannelMap[lastTrackNum] = channel;
-//    }
+    // Other system messages aren't allowed in a MIDI file, and
+    // we don't know how long they are.
+    if( ( statusByte & MIDI_MESSAGE_TYPE_MASK ) ==
+        MIDI_SYSTEM_EXCLUSIVE )
+      throw Exception( "Unsupported MIDI Status Byte" );
+
+    runningStatus = statusByte;
+
+    int channel = ( statusByte & MIDI_CHANNEL_NUM_MASK );
+
+    // If this channel hasn't been seen yet in this MIDI file track
+    if( channelToTrack[channel] == -1 ) {
+      // If this is the first m_midiComposition track we've used
+      if( firstTrack ) {
+        // We've already allocated an m_midiComposition track for
+        // the first channel we encounter.  Use it.
+        firstTrack = false;
+      } else { // We need a new track.
+        // Allocate a new track for this channel.
+        ++lastTrackNum;
+        tracks[lastTrackNum - metaTrack] =
+            &m_midiComposition[lastTrackNum];
+        lastEventTime[lastTrackNum - metaTrack] = 0;
+      }
 
-//    TrackId trackNum = channelToTrack[channel];
+      channelToTrack[channel]         = lastTrackNum;
+      m_trackChannelMap[lastTrackNum] = channel;
+    }
 
-//#ifdef DEBUG
-//    {
-//      static int prevTrackNum = -1;
-//      static int prevChannel  = -1;
-
-//      // If we're on a different track or channel
-//      if( prevTrackNum != static_cast<int>( trackNum ) ||
-//          prevChannel != channel ) {
-//        // Report it for debugging.
-//        RG_DEBUG << "parseTrack(): track number for channel "
-//                 << channel << " is " << trackNum;
-
-//        prevTrackNum = trackNum;
-//        prevChannel  = channel;
-//      }
-//    }
-//#endif
+    const int      part     = channelToTrack[channel] - metaTrack;
+    MidiTrack&     track    = *tracks[part];
+    unsigned long& lastTime = lastEventTime[part];
+
+    switch( statusByte & MIDI_MESSAGE_TYPE_MASK ) {
+      case MIDI_NOTE_ON:
+      case MIDI_NOTE_OFF: {
+        MidiByte data2 = read();
+
+        std::vector<PendingNote>& notes =
+            pendingNotes[channel * 128 + ( data1 & 0x7F )];
+
+        // Note-on with velocity 0 is a note-off.
+        if( ( statusByte & MIDI_MESSAGE_TYPE_MASK ) ==
+                MIDI_NOTE_ON &&
+            data2 != 0 ) {
+          MidiEvent* midiEvent =
+              new MidiEvent( 0, statusByte, data1, data2 );
+          appendEvent( track, lastTime, eventTime, midiEvent );
+          PendingNote note = { midiEvent, eventTime };
+          notes.push_back( note );
+          break;
+        }
 
-//    // Compute the difference between this event and the
-//    previous
-//    // event on this track.
-//    deltaTime = eventTime - lastEventTime[trackNum];
-//    // Store the absolute time of the last event on this track.
-//    lastEventTime[trackNum] = eventTime;
-
-//    switch( statusByte & MIDI_MESSAGE_TYPE_MASK ) {
-//      case MIDI_NOTE_ON: // These events have two data bytes.
-//      case MIDI_NOTE_OFF:
-//      case MIDI_POLY_AFTERTOUCH:
-//      case MIDI_CTRL_CHANGE:
-//      case MIDI_PITCH_BEND: {
-//        MidiByte data2 = read( midiFile );
-
-//        // create and store our event
-//        MidiEvent *midiEvent =
-//            new MidiEvent( deltaTime, statusByte, data1, data2
-//            );
-//        m_midiComposition[trackNum].push_back( midiEvent );
-
-//        if( statusByte != MIDI_PITCH_BEND ) {
-//          RG_DEBUG << "parseTrack(): MIDI event for channel "
-//                   << channel + 1 << " (track " << trackNum
-//                   << ')';
-//          RG_DEBUG << *midiEvent;
-//        }
-//      } break;
-
-//      case MIDI_PROG_CHANGE: // These events have a single data
-//                             // byte.
-//      case MIDI_CHNL_AFTERTOUCH: {
-//        RG_DEBUG << "parseTrack(): Program change (Cn) or "
-//                    "channel aftertouch (Dn): time "
-//                 << deltaTime << ", code "
-//                 << QString( "0x%1" ).arg( statusByte, 0, 16 )
-//                 << ", data " << (int)data1 << " going to track
-//                 "
-//                 << trackNum;
-
-//        // create and store our event
-//        MidiEvent *midiEvent =
-//            new MidiEvent( deltaTime, statusByte, data1 );
-//        m_midiComposition[trackNum].push_back( midiEvent );
-//      } break;
-
-//      case MIDI_SYSTEM_EXCLUSIVE: {
-//        unsigned messageLength = readNumber( midiFile, data1 );
-
-//        RG_DEBUG << "parseTrack(): SysEx of " << messageLength
-//                 << " bytes found";
-
-//        std::string sysex = read( midiFile, messageLength );
-
-//        if( MidiByte( sysex[sysex.length() - 1] ) !=
-//            MIDI_END_OF_EXCLUSIVE ) {
-//          RG_WARNING << "parseTrack() - malformed or "
-//                        "unsupported SysEx type";
-//          continue;
-//        }
+        // A note-off with no note-on to end is kept as it is.
+        if( notes.empty() ) {
+          appendEvent(
+              track, lastTime, eventTime,
+              new MidiEvent( 0, statusByte, data1, data2 ) );
+          break;
+        }
+
+        endNote( notes.front(), eventTime );
+        notes.erase( notes.begin() );
+      } break;
+
+      case MIDI_POLY_AFTERTOUCH: // These events have two data
+      case MIDI_CTRL_CHANGE:     // bytes.
+      case MIDI_PITCH_BEND: {
+        MidiByte data2 = read();
+
+        // create and store our event
+        appendEvent(
+            track, lastTime, eventTime,
+            new MidiEvent( 0, statusByte, data1, data2 ) );
+      } break;
+
+      case MIDI_PROG_CHANGE: // These events have a single data
+                             // byte.
+      case MIDI_CHNL_AFTERTOUCH: {
+        // create and store our event
+        appendEvent( track, lastTime, eventTime,
+                     new MidiEvent( 0, statusByte, data1 ) );
+      } break;
+
+      default: break;
+    }
+  }
 
-//        // Chop off the EOX.
-//        sysex = sysex.substr( 0, sysex.length() - 1 );
-
-//        // create and store our event
-//        MidiEvent *midiEvent = new MidiEvent(
-//            deltaTime, MIDI_SYSTEM_EXCLUSIVE, sysex );
-//        m_midiComposition[trackNum].push_back( midiEvent );
-//      } break;
-
-//      case MIDI_END_OF_EXCLUSIVE:
-//        RG_WARNING << "parseTrack() - Found a stray "
-//                      "MIDI_END_OF_EXCLUSIVE";
-//        break;
-
-//      default:
-//        RG_WARNING
-//            << "parseTrack() - Unsupported MIDI Status Byte:  "
-//            << QString( "0x%1" ).arg( statusByte, 0, 16 );
-//        break;
-//    }
-//  }
+  // Notes still sounding at the end of the track last until then.
+  for( size_t i = 0; i < pendingNotes.size(); ++i ) {
+    for( size_t n = 0; n < pendingNotes[i].size(); ++n )
+      endNote( pendingNotes[i][n], eventTime );
+  }
 
-//  // If the MIDI file track has a padding byte, read and
-//  discard
-//  // it to make sure that the stream is positioned at the
-//  // beginning of the following MIDI file track (if there is
-//  // one.)
-//  if( m_trackByteCount == 1 ) midiFile->ignore();
+  // Skip the padding byte, if any, so that we are at the
+  // beginning of the following chunk (if there is one.)
+  m_readPos = m_readEnd;
 
-//  if( instrumentName != "" )
-//    trackName += " (" + instrumentName + ")";
+  if( instrumentName != "" )
+    trackName += " (" + instrumentName + ")";
 
-//  // Fill out the Track Names
-//  for( TrackId i = metaTrack; i <= lastTrackNum; ++i )
-//    m_trackNames.push_back( trackName );
-//}
+  // Fill out the Track Names
+  for( TrackId i = metaTrack; i <= lastTrackNum; ++i )
+    m_trackNames.push_back( trackName );
+}
 
 // bool MidiFile::convertToRosegarden( const QString & filename,
 //                                    RosegardenDocument *doc ) {
@@ -1435,62 +1345,218 @@ bool MidiFile::convertToMidi( Composition&       comp,
   return false;
 }
 
+bool MidiFile::convertToMidi( RosegardenDocument&  doc,
+                              std::string const&   filename,
+                              ExportOptions const& options ) {
+  Export e;
+  e.filename = filename;
+  e.options  = options;
+  return convertToMidi( doc, ExportList( 1, e ) );
+}
+
+namespace {
+
+// Insert the tempo and time signature in effect at time, which
+// the mappers only send where they change.
+void insertConductorState( Composition& comp, timeT time,
+                           MappedInserterBase& inserter ) {
+  RealTime eventTime = comp.getElapsedRealTime( time );
+
+  // The tempo mapper always sends the tempo at zero.
+  int n = comp.getTempoChangeNumberAt( time );
+  if( eventTime > RealTime::zeroTime &&
+      ( n < 0 || comp.getTempoChange( n ).first < time ) ) {
+    // As TempoSegmentMapper::mapATempo() does.
+    MappedEvent e;
+    e.setType( MappedEvent::Tempo );
+    e.setEventTime( eventTime );
+    e.setInstrument( comp.getTempoAtTime( time ) );
+    e.setData1(
+        n >= 0 && comp.getTempoRamping( n, false ).first ? 1 : 0 );
+    inserter.insertCopy( e );
+  }
+
+  TimeSignature timeSig;
+  if( comp.getTimeSignatureCount() > 0 &&
+      comp.getTimeSignatureAt( time, timeSig ) < time ) {
+    MappedEvent e;
+    e.setType( MappedEvent::TimeSignature );
+    e.setEventTime( eventTime );
+    e.setData1( timeSig.getNumerator() );
+    e.setData2( timeSig.getDenominator() );
+    inserter.insertCopy( e );
+  }
+}
+
+} // namespace
+
 bool MidiFile::convertToMidi( RosegardenDocument& doc,
-                              std::string const&  filename ) {
-  auto& comp         = doc.getComposition();
+                              ExportList const&   exports,
+                              ExportRange const&  range ) {
+  auto& comp = doc.getComposition();
+
+  timeT startTime = comp.getStartMarker();
+  timeT endTime   = comp.getEndMarker();
+  if( range.isTimeLimited() ) {
+    startTime = range.startTime;
+    endTime   = range.endTime;
+  }
+
+  // Segments outside the range or on other tracks are never
+  // mapped.
   auto* m_seqManager = new SequenceManager();
   m_seqManager->setDocument( &doc );
-  m_seqManager->resetCompositionMapper();
+  m_seqManager->resetCompositionMapper( startTime, endTime,
+                                        range.tracks );
 
   MappedBufMetaIterator* metaIterator =
       m_seqManager->makeTempMetaiterator();
 
-  RealTime start =
-      comp.getElapsedRealTime( comp.getStartMarker() );
-  RealTime end = comp.getElapsedRealTime( comp.getEndMarker() );
+  RealTime start = comp.getElapsedRealTime( startTime );
+  RealTime end   = comp.getElapsedRealTime( endTime );
 
   // For ramping, we need to get MappedEvents in order, but
   // fetchEvents's order is only approximately
   // right, so we sort events first.
   SortingInserter sorter;
 
+  // An excerpt starts with the state things were in at its start.
+  // Whole exports keep their time and setup from zero.
+  timeT origin = 0;
+  if( range.isTimeLimited() ) {
+    origin = startTime;
+    insertConductorState( comp, startTime, sorter );
+  }
+
   // Fetch the channel setup for all MIDI tracks in Fixed channel
   // mode.
-  metaIterator->fetchFixedChannelSetup( sorter );
+  metaIterator->fetchFixedChannelSetup(
+      sorter, range.isTimeLimited() ? start : RealTime::zeroTime );
 
   metaIterator->jumpToTime( start );
-  // Copy the events from metaIterator to sorter.
+  // Copy the events from metaIterator to sorter, leaving out those
+  // that are over by the start.
   // Give the end a little margin to make it insert noteoffs at
   // the end.  If they tied with the end they'd get lost.
-  metaIterator->fetchEvents( sorter, start,
+  ExcerptInserter excerpt( sorter, start, end );
+  metaIterator->fetchEvents( excerpt, start,
                              end + RealTime( 0, 1000 ) );
+  // Notes still sounding at the end stop there.
+  excerpt.closeNotes();
 
   delete metaIterator;
 
-  MidiInserter inserter( comp, 480, end );
-  // Copy the events from sorter to inserter.
-  sorter.insertSorted( inserter );
-  // Finally, copy the events from inserter to m_midiComposition.
-  inserter.assignToMidiFile( *this );
+  // One inserter per file, or per part of a split export, all
+  // fed from the one sorted pass.
+  std::vector<MidiInserter*>      inserters( exports.size() );
+  std::vector<SplitMidiInserter*> splitters( exports.size() );
+  FanOutInserter                  fanOut;
+  for( size_t i = 0; i < exports.size(); ++i ) {
+    const ExportOptions& options = exports[i].options;
+    if( options.split == ExportOptions::NoSplit ) {
+      inserters[i] = new MidiInserter( comp, options, origin, end );
+      fanOut.addInserter( inserters[i] );
+    } else {
+      splitters[i] =
+          new SplitMidiInserter( comp, options, origin, end );
+      fanOut.addInserter( splitters[i] );
+    }
+  }
+
+  // Copy the events from sorter to the inserters.
+  sorter.insertSorted( fanOut );
+
+  bool ok = true;
+  for( size_t i = 0; i < exports.size(); ++i ) {
+    const ExportOptions& options  = exports[i].options;
+    const std::string&   filename = exports[i].filename;
+    ByteSink*            sink     = exports[i].sink;
+
+    if( inserters[i] ) {
+      if( !( sink ? write( *inserters[i], options, *sink )
+                  : write( *inserters[i], options, filename ) ) )
+        ok = false;
+      delete inserters[i];
+      continue;
+    }
+
+    // The parts need files of their own.
+    if( sink || filename == "-" ) {
+      ok = false;
+      delete splitters[i];
+      continue;
+    }
+
+    // Name each part's file after its track, before the
+    // extension if there is one.
+    std::string::size_type dot   = filename.rfind( '.' );
+    std::string::size_type slash = filename.rfind( '/' );
+    if( dot == std::string::npos ||
+        ( slash != std::string::npos && dot < slash ) )
+      dot = filename.length();
+
+    const SplitMidiInserter::Parts& parts = splitters[i]->getParts();
+    for( SplitMidiInserter::Parts::const_iterator part =
+             parts.begin();
+         part != parts.end(); ++part ) {
+      const Track* track = comp.getTrackById( part->first.first );
+      std::ostringstream name;
+      name << filename.substr( 0, dot ) << "-track"
+           << ( track ? track->getPosition() + 1 : 0 );
+      if( part->first.second >= 0 )
+        name << "-ch" << part->first.second + 1;
+      name << filename.substr( dot );
+
+      if( !write( *part->second, options, name.str() ) ) ok = false;
+    }
+    delete splitters[i];
+  }
+
+  return ok;
+}
+
+bool MidiFile::write( MidiInserter&        inserter,
+                      ExportOptions const& options,
+                      std::string const&   filename ) {
+  // Copy the events from the inserter to m_midiComposition,
+  // deleting those of any earlier export.
+  clearMidiComposition();
+  m_noteOffAsNoteOn = options.compact;
+  inserter.assignToMidiFile(
+      *this, options.singleTrack ? MIDI_SINGLE_TRACK_FILE
+                                 : MIDI_SIMULTANEOUS_TRACK_FILE );
 
   // Write m_midiComposition to the file.
   return write( filename );
 }
 
-void MidiFile::writeInt( std::ofstream* midiFile, int number ) {
-  *midiFile << static_cast<MidiByte>( ( number & 0xFF00 ) >> 8 );
-  *midiFile << static_cast<MidiByte>( number & 0x00FF );
+bool MidiFile::write( MidiInserter&        inserter,
+                      ExportOptions const& options,
+                      ByteSink&            sink ) {
+  clearMidiComposition();
+  m_noteOffAsNoteOn = options.compact;
+  inserter.assignToMidiFile(
+      *this, options.singleTrack ? MIDI_SINGLE_TRACK_FILE
+                                 : MIDI_SIMULTANEOUS_TRACK_FILE );
+
+  return write( sink );
+}
+
+void MidiFile::writeInt( ByteSink* midiFile, int number ) {
+  char bytes[2];
+  bytes[0] = static_cast<char>( ( number & 0xFF00 ) >> 8 );
+  bytes[1] = static_cast<char>( number & 0x00FF );
+  midiFile->write( bytes, 2 );
 }
 
-void MidiFile::writeLong( std::ofstream* midiFile,
-                          unsigned long  number ) {
-  *midiFile << static_cast<MidiByte>( ( number & 0xFF000000 ) >>
-                                      24 );
-  *midiFile << static_cast<MidiByte>( ( number & 0x00FF0000 ) >>
-                                      16 );
-  *midiFile << static_cast<MidiByte>( ( number & 0x0000FF00 ) >>
-                                      8 );
-  *midiFile << static_cast<MidiByte>( number & 0x000000FF );
+void MidiFile::writeLong( ByteSink*     midiFile,
+                          unsigned long number ) {
+  char bytes[4];
+  bytes[0] = static_cast<char>( ( number & 0xFF000000 ) >> 24 );
+  bytes[1] = static_cast<char>( ( number & 0x00FF0000 ) >> 16 );
+  bytes[2] = static_cast<char>( ( number & 0x0000FF00 ) >> 8 );
+  bytes[3] = static_cast<char>( number & 0x000000FF );
+  midiFile->write( bytes, 4 );
 }
 
 std::string MidiFile::longToVarBuffer( unsigned long value ) {
@@ -1522,23 +1588,20 @@ std::string MidiFile::longToVarBuffer( unsigned long value ) {
   return returnString;
 }
 
-void MidiFile::writeHeader( std::ofstream* midiFile ) {
+void MidiFile::writeHeader( ByteSink* midiFile ) {
   // Our identifying Header string
-  *midiFile << MIDI_FILE_HEADER;
+  midiFile->write( MIDI_FILE_HEADER, 4 );
 
   // Write number of Bytes to follow
-  *midiFile << static_cast<MidiByte>( 0x00 );
-  *midiFile << static_cast<MidiByte>( 0x00 );
-  *midiFile << static_cast<MidiByte>( 0x00 );
-  *midiFile << static_cast<MidiByte>( 0x06 );
+  writeLong( midiFile, 6 );
 
   writeInt( midiFile, static_cast<int>( m_format ) );
   writeInt( midiFile, m_numberOfTracks );
   writeInt( midiFile, m_timingDivision );
 }
 
-void MidiFile::writeTrack( std::ofstream* midiFile,
-                           TrackId        trackNumber ) {
+void MidiFile::writeTrack( ByteSink* midiFile,
+                           TrackId   trackNumber ) {
   // For running status.
   MidiByte previousEventCode = 0;
 
@@ -1595,18 +1658,30 @@ void MidiFile::writeTrack( std::ofstream* midiFile,
       previousEventCode = 0;
 
     } else { // non-meta event
+      MidiByte eventCode = midiEvent.getEventCode();
+      MidiByte data2     = midiEvent.getData2();
+
+      // A note-off with the default velocity says no more than a
+      // note-on with velocity 0, which can go under the running
+      // status of the note-ons around it.
+      if( m_noteOffAsNoteOn &&
+          midiEvent.getMessageType() == MIDI_NOTE_OFF &&
+          data2 == 64 ) {
+        eventCode = MIDI_NOTE_ON | midiEvent.getChannelNumber();
+        data2     = 0;
+      }
+
       // If the event code has changed, or this is a SYSEX event,
       // we can't use running status. Running status is "[f]or
       // Voice and Mode messages only." Sysex is a system
       // message.  See the MIDI spec, Section 2, page 5.
-      if( ( midiEvent.getEventCode() != previousEventCode ) ||
-          ( midiEvent.getEventCode() ==
-            MIDI_SYSTEM_EXCLUSIVE ) ) {
+      if( ( eventCode != previousEventCode ) ||
+          ( eventCode == MIDI_SYSTEM_EXCLUSIVE ) ) {
         // Send the normal event code (with encoded channel
         // information)
-        trackBuffer += midiEvent.getEventCode();
+        trackBuffer += eventCode;
 
-        previousEventCode = midiEvent.getEventCode();
+        previousEventCode = eventCode;
       }
 
       switch( midiEvent.getMessageType() ) {
@@ -1616,7 +1691,7 @@ void MidiFile::writeTrack( std::ofstream* midiFile,
         case MIDI_CTRL_CHANGE:
         case MIDI_POLY_AFTERTOUCH:
           trackBuffer += midiEvent.getData1();
-          trackBuffer += midiEvent.getData2();
+          trackBuffer += data2;
           break;
 
         case MIDI_PROG_CHANGE: // These have one data byte.
@@ -1640,12 +1715,17 @@ void MidiFile::writeTrack( std::ofstream* midiFile,
 
   // Now we write the track to the file.
 
-  *midiFile << MIDI_TRACK_HEADER;
+  midiFile->write( MIDI_TRACK_HEADER, 4 );
   writeLong( midiFile, trackBuffer.length() );
-  *midiFile << trackBuffer;
+  midiFile->write( trackBuffer.data(), trackBuffer.length() );
 }
 
 bool MidiFile::write( const std::string& filename ) {
+  if( filename == "-" ) {
+    StreamByteSink standardOutput( std::cout );
+    return write( standardOutput );
+  }
+
   std::ofstream midiFile( filename,
                           std::ios::out | std::ios::binary );
 
@@ -1654,11 +1734,16 @@ bool MidiFile::write( const std::string& filename ) {
     return false;
   }
 
-  writeHeader( &midiFile );
+  StreamByteSink sink( midiFile );
+  return write( sink );
+}
+
+bool MidiFile::write( ByteSink& sink ) {
+  writeHeader( &sink );
 
   // For each track, write it out.
   for( TrackId i = 0; i < m_numberOfTracks; ++i ) {
-    writeTrack( &midiFile, i );
+    writeTrack( &sink, i );
 
     // if( m_progressDialog && m_progressDialog->wasCanceled() )
     //  return false;
@@ -1667,113 +1752,32 @@ bool MidiFile::write( const std::string& filename ) {
     //  m_progressDialog->setValue( i * 100 / m_numberOfTracks );
   }
 
-  midiFile.close();
-
+  if( !sink.flush() ) {
+    m_format = MIDI_FILE_NOT_LOADED;
+    return false;
+  }
   return true;
 }
 
-// void MidiFile::consolidateNoteEvents( TrackId trackId ) {
-//  MidiTrack &track = m_midiComposition[trackId];
-
-//  // For each MIDI event on the track.
-//  for( MidiTrack::iterator firstEventIter = track.begin();
-//       firstEventIter != track.end(); ++firstEventIter ) {
-//    MidiEvent &firstEvent = **firstEventIter;
-
-//    // Not a note-on?  Try the next event.
-//    if( firstEvent.getMessageType() != MIDI_NOTE_ON ) continue;
-
-//    // Note-on with velocity 0 is a note-off.  Try the next
-//    // event.
-//    if( firstEvent.getVelocity() == 0 ) continue;
-
-//    // At this point, firstEvent is a note-on event.
-//    // Search for the matching note-off event.
-
-//    bool noteOffFound = false;
-
-//    MidiTrack::iterator secondEventIter;
-
-//    // For each following MIDI event
-//    for( secondEventIter = firstEventIter + 1;
-//         secondEventIter != track.end(); ++secondEventIter ) {
-//      const MidiEvent &secondEvent = **secondEventIter;
-
-//      bool noteOff =
-//          ( secondEvent.getMessageType() == MIDI_NOTE_OFF ||
-//            ( secondEvent.getMessageType() == MIDI_NOTE_ON &&
-//              secondEvent.getVelocity() == 0x00 ) );
-
-//      // Not a note-off?  Try the next event.
-//      if( !noteOff ) continue;
-
-//      // Wrong pitch?  Try the next event.
-//      if( secondEvent.getPitch() != firstEvent.getPitch() )
-//        continue;
-
-//      // Wrong channel?  Try the next event.
-//      // Note: Since all the events in a track are for a single
-//      // channel,
-//      //       this will never be true.
-//      if( secondEvent.getChannelNumber() !=
-//          firstEvent.getChannelNumber() )
-//        continue;
-
-//      timeT noteDuration =
-//          secondEvent.getTime() - firstEvent.getTime();
-
-//      // Some MIDI files floating around in the real world
-//      // apparently have note-on followed immediately by
-//      note-off
-//      // on percussion tracks.  Instead of setting the duration
-//      // to 0 in this case, which has no meaning, set it to 1.
-//      if( noteDuration == 0 ) {
-//        RG_WARNING << "consolidateNoteEvents() - detected MIDI
-//        "
-//                      "note duration of 0.  Using duration of "
-//                      "1.  Touch wood.";
-//        noteDuration = 1;
-//      }
-
-//      firstEvent.setDuration( noteDuration );
-
-//      // Remove the note-off.
-//      delete *secondEventIter;
-//      track.erase( secondEventIter );
-
-//      noteOffFound = true;
-//      break;
-//    }
-
-//    if( !noteOffFound ) {
-//      // avoid crash due to secondEventIter == track.end()
-//      --secondEventIter;
-//      // Set Event duration to length of Segment.
-//      firstEvent.setDuration( ( *secondEventIter )->getTime() -
-//                              firstEvent.getTime() );
-//    }
-//  }
-//}
-
-// void MidiFile::clearMidiComposition() {
-//  // For each track
-//  for( MidiComposition::iterator trackIter =
-//           m_midiComposition.begin();
-//       trackIter != m_midiComposition.end(); ++trackIter ) {
-//    MidiTrack &midiTrack = trackIter->second;
-
-//    // For each event on the track.
-//    for( MidiTrack::iterator eventIter = midiTrack.begin();
-//         eventIter != midiTrack.end(); ++eventIter ) {
-//      delete *eventIter;
-//    }
+void MidiFile::clearMidiComposition() {
+  // For each track
+  for( MidiComposition::iterator trackIter =
+           m_midiComposition.begin();
+       trackIter != m_midiComposition.end(); ++trackIter ) {
+    MidiTrack& midiTrack = trackIter->second;
+
+    // For each event on the track.
+    for( MidiTrack::iterator eventIter = midiTrack.begin();
+         eventIter != midiTrack.end(); ++eventIter ) {
+      delete *eventIter;
+    }
 
-//    midiTrack.clear();
-//  }
+    midiTrack.clear();
+  }
 
-//  m_midiComposition.clear();
-//  m_trackChannelMap.clear();
-//  m_trackNames.clear();
-//}
+  m_midiComposition.clear();
+  m_trackChannelMap.clear();
+  m_trackNames.clear();
+}
 
 } // namespace Rosegarden
@@ -19,6 +19,7 @@
 #include "RosegardenDocument.h"
 
 #include <fstream>
+#include <set>
 #include <string>
 #include <vector>
 #include <map>
@@ -26,8 +27,10 @@
 namespace Rosegarden
 {
 
+class ByteSink;
 class Composition;
 class MidiEvent;
+class MidiInserter;
 
 /// Conversion class for Composition to and from MIDI Files.
 class MidiFile
@@ -36,6 +39,108 @@ public:
     MidiFile();
     ~MidiFile();
 
+    /// How convertToMidi() lays out the file.
+    struct ExportOptions
+    {
+        ExportOptions() :
+            timingDivision(480),
+            singleTrack(false),
+            compact(false),
+            controllerTolerance(-1),
+            tempoRampDivision(16),
+            split(NoSplit)
+        { }
+
+        /// Pulses per quarter note.
+        int timingDivision;
+
+        /// Write format 0: all events merged into one track.
+        /**
+         * Otherwise format 1 is written, with a conductor track and a
+         * track per Rosegarden track and channel.
+         */
+        bool singleTrack;
+
+        /// Write note-offs as note-ons with velocity 0.
+        /**
+         * Note-offs then share running status with the note-ons around
+         * them, which saves a status byte on most note events.  Only
+         * note-offs with the default velocity of 64 are written this
+         * way, since the velocity is lost.
+         */
+        bool compact;
+
+        /// Thin out controller and pitch bend events.
+        /**
+         * Events that move their value by no more than this many
+         * controller steps from the value held are dropped.  0 drops
+         * only repeated values, -1 drops nothing.
+         */
+        int controllerTolerance;
+
+        /// How finely tempo ramps are written.
+        /**
+         * A ramp is written as a tempo change every whole note divided
+         * by this, so 16 is every semiquaver.
+         */
+        int tempoRampDivision;
+
+        enum Split {
+            NoSplit,
+            SplitByTrack,
+            SplitByChannel
+        };
+        /// Write each track, or track and channel, to a file of its own.
+        /**
+         * Each file gets a copy of the conductor track.  Files are named
+         * after the export's filename with "-trackN", or "-trackN-chC",
+         * added before the extension, N being the track's position
+         * counted from 1.
+         */
+        Split split;
+    };
+
+    /// A file for convertToMidi() to write, and how.
+    struct Export
+    {
+        Export() : sink(nullptr) { }
+
+        /// Where to write the file.  "-" is standard output.
+        std::string filename;
+
+        /// If set, the file is written here instead.  Not owned.
+        /**
+         * A sink, or "-", takes a single file, so it can't be used with
+         * a split export.
+         */
+        ByteSink *sink;
+
+        ExportOptions options;
+    };
+    typedef std::vector<Export> ExportList;
+
+    /// The part of the composition convertToMidi() exports.
+    struct ExportRange
+    {
+        ExportRange() : startTime(0), endTime(0) { }
+
+        /// Whether a time range is set.
+        bool isTimeLimited() const { return endTime > startTime; }
+
+        /// Composition times.
+        /**
+         * Unless endTime is after startTime, everything from the start
+         * marker to the end marker is exported.  Otherwise startTime
+         * is at the start of the files, with the tempo, time signature
+         * and controllers that were in effect there.
+         */
+        timeT startTime;
+        timeT endTime;
+
+        /// The tracks to export.  All of them if empty.
+        std::set<TrackId> tracks;
+    };
+
     /// Convert a Rosegarden composition to a MIDI file.
     /*
      * Returns true on success.
@@ -43,7 +148,51 @@ public:
      * See RosegardenMainWindow::exportMIDIFile().
      */
     bool convertToMidi(Composition &, std::string const& filename);
-    bool convertToMidi(RosegardenDocument &, std::string const& filename);
+    bool convertToMidi(RosegardenDocument &, std::string const& filename,
+                       const ExportOptions &options = ExportOptions());
+    /// Write several MIDI files from one mapping of the composition.
+    /**
+     * The composition is mapped and its events sorted once, then fed to
+     * a MidiInserter per file.  Returns true if all were written.
+     *
+     * Only the segments that play within range are mapped, so an
+     * excerpt costs about what its own segments do.
+     */
+    bool convertToMidi(RosegardenDocument &, const ExportList &exports,
+                       const ExportRange &range = ExportRange());
+
+    /**
+     * Our internal MIDI composition is just a vector of MidiEvents.
+     * We use a vector and not a set because we want the order of
+     * the events to be arbitrary until we explicitly sort them
+     * (necessary when converting Composition absolute times to
+     * MIDI delta times).
+     */
+    typedef std::vector<MidiEvent *> MidiTrack;
+    typedef std::map<TrackId, MidiTrack> MidiComposition;
+
+    /// Read a Standard MIDI File, eg to check one we wrote.
+    /**
+     * The file is mapped into memory and parsed in place.  As in
+     * Rosegarden's importer, each track of the file becomes a track
+     * per channel, the first of which also gets the meta events and
+     * sysex, and each note-on is paired with its note-off into one
+     * note-on with a duration.  Event times are deltas from the
+     * previous event on the same track.
+     *
+     * Returns false if the file can't be read; see getError().
+     */
+    bool read(std::string const& filename);
+    const std::string &getError() const { return m_error; }
+
+    /// The tracks read.  See read().
+    const MidiComposition &getMidiComposition() const
+        { return m_midiComposition; }
+    /// The name of each track read, with its instrument name if any.
+    const std::vector<std::string> &getTrackNames() const
+        { return m_trackNames; }
+    /// Pulses per quarter note of the file read.
+    int getTimingDivision() const { return m_timingDivision; }
 
 private:
     // convertToMidi() uses MidiInserter.
@@ -83,33 +232,23 @@ private:
 
     // *** Internal MIDI Composition
 
-    /**
-     * Our internal MIDI composition is just a vector of MidiEvents.
-     * We use a vector and not a set because we want the order of
-     * the events to be arbitrary until we explicitly sort them
-     * (necessary when converting Composition absolute times to
-     * MIDI delta times).
-     */
-    typedef std::vector<MidiEvent *> MidiTrack;
-    typedef std::map<TrackId, MidiTrack> MidiComposition;
     MidiComposition m_midiComposition;
     void clearMidiComposition();
 
     // *** Standard MIDI File to Rosegarden
 
-    /// Read a MIDI file into m_midiComposition.
-    bool read(std::string const& filename);
-    void parseHeader(std::ifstream *midiFile);
+    void parseHeader();
     /// Convert a track to events in m_midiComposition.
-    void parseTrack(std::ifstream *midiFile);
+    /**
+     * Note-ons are paired with their note-offs as they are read.
+     */
+    void parseTrack();
     // m_midiComposition track to MIDI channel.
     std::map<TrackId, int /*channel*/> m_trackChannelMap;
     // Names for each track.
     std::vector<std::string> m_trackNames;
-    /// Find the next track chunk and set m_trackByteCount.
-    void findNextTrack(std::ifstream *midiFile);
-    /// Combine each note-on/note-off pair into a single note event with a duration.
-    void consolidateNoteEvents(TrackId trackId);
+    /// Find the next track chunk and limit reading to it.
+    void findNextTrack();
     /// Configure the Instrument based on events in Segment at time 0.
     //static void configureInstrument(
     //        Track *track, Segment *segment, Instrument *instrument);
@@ -120,42 +259,44 @@ private:
      * In case the first byte has already been read, it can be sent
      * in as firstByte.
      */
-    long readNumber(std::ifstream *midiFile, int firstByte = -1);
-    MidiByte read(std::ifstream *midiFile);
-    std::string read(std::ifstream *midiFile,
-                     unsigned long numberOfBytes);
+    long readNumber(int firstByte = -1);
+    MidiByte read();
+    std::string read(unsigned long numberOfBytes);
 
     // Conversion
-    int midiBytesToInt(const std::string &bytes);
-    long midiBytesToLong(const std::string &bytes);
-
-    size_t m_fileSize;
-    /// Number of bytes left to read in the current track.
-    long m_trackByteCount;
-    /// Allow decrementing of m_trackByteCount while reading.
-    /**
-     * Set to true while processing a track.  false while processing other
-     * parts of the file.
-     */
-    bool m_decrementCount;
+    int midiBytesToInt(const MidiByte *bytes);
+    unsigned long midiBytesToLong(const MidiByte *bytes);
 
-    /// Counter for kicking the message loop.
-    int m_bytesRead;
+    // The file being read, while read() runs.  Reading stops at
+    // m_readEnd, the end of the current chunk.
+    const MidiByte *m_readPos;
+    const MidiByte *m_readEnd;
+    const MidiByte *m_fileEnd;
 
     std::string m_error;
 
     // *** Rosegarden to Standard MIDI File
 
-    /// Write m_midiComposition to a MIDI file.
+    /// Write note-offs as note-ons with velocity 0.  See ExportOptions.
+    bool m_noteOffAsNoteOn;
+
+    /// Write the events in inserter to a MIDI file.
+    bool write(MidiInserter &inserter, const ExportOptions &options,
+               std::string const& filename);
+    bool write(MidiInserter &inserter, const ExportOptions &options,
+               ByteSink &sink);
+
+    /// Write m_midiComposition to a MIDI file.  "-" is standard output.
     bool write(std::string const& filename);
-    void writeHeader(std::ofstream *midiFile);
-    void writeTrack(std::ofstream *midiFile, TrackId trackNumber);
+    bool write(ByteSink &sink);
+    void writeHeader(ByteSink *midiFile);
+    void writeTrack(ByteSink *midiFile, TrackId trackNumber);
 
     // Write
     /// Write an int as 2 bytes.
-    void writeInt(std::ofstream *midiFile, int number);
+    void writeInt(ByteSink *midiFile, int number);
     /// Write a long as 4 bytes.
-    void writeLong(std::ofstream *midiFile, unsigned long number);
+    void writeLong(ByteSink *midiFile, unsigned long number);
 
     // Conversion
     /// Convert a value to a "variable-length quantity" in a std::string.
@@ -28,11 +28,39 @@
 #include "MidiFile.h"
 #include "MidiTypes.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
 #include <string>
+#include <utility>
+#include <vector>
 
 #define MIDI_DEBUG 1
 
 namespace Rosegarden {
+
+namespace {
+
+// Whether controller holds a value, rather than selecting a
+// parameter, entering data for it, or being a channel mode
+// message, which are commands.
+bool isStateController( MidiByte controller ) {
+  switch( controller ) {
+    case 0x06:
+    case 0x26:
+    case 0x60:
+    case 0x61:
+    case MIDI_CONTROLLER_NRPN_1:
+    case MIDI_CONTROLLER_NRPN_2:
+    case MIDI_CONTROLLER_RPN_1:
+    case MIDI_CONTROLLER_RPN_2: return false;
+    default: return controller < MIDI_CONTROLLER_SOUNDS_OFF;
+  }
+}
+
+} // namespace
+
 /*** TrackData ***/
 
 // Insert and take ownership of a MidiEvent.  The event's time is
@@ -75,6 +103,19 @@ void MidiInserter::TrackData::insertTempo( timeT t,
       t, MIDI_FILE_META_EVENT, MIDI_SET_TEMPO, tempoString ) );
 }
 
+/*** ChannelState ***/
+
+void MidiInserter::ChannelState::forget() {
+  m_program     = -1;
+  m_bankPending = false;
+  forgetControllers();
+}
+
+void MidiInserter::ChannelState::forgetControllers() {
+  for( int i = 0; i < 128; ++i ) m_controllers[i] = -1;
+  m_pitchBend = -1;
+}
+
 /*** MidiInserter ***/
 const timeT MidiInserter::crotchetDuration =
     Note( Note::Crotchet ).getDuration();
@@ -84,27 +125,92 @@ MidiInserter::MidiInserter( Composition &composition,
                             RealTime     trueEnd )
   : m_comp( composition ),
     m_timingDivision( timingDivision ),
+    m_startTime( 0 ),
     m_finished( false ),
     m_trueEnd( trueEnd ),
-    m_previousRealTime( RealTime::zeroTime ),
-    m_previousTime( 0 ),
-    m_ramping( false ) {
+    m_controllerTolerance( -1 ),
+    m_ramping( false ),
+    m_rampStep( crotchetDuration / 4 ),
+    m_rampStepTime( 0 ),
+    m_rampEnd( 0 ),
+    m_rampTempo( 0 ) {
   setup();
 }
 
+MidiInserter::MidiInserter( Composition &                  composition,
+                            const MidiFile::ExportOptions &options,
+                            timeT                          startTime,
+                            RealTime                       trueEnd )
+  : MidiInserter( composition, options.timingDivision, trueEnd ) {
+  m_startTime           = startTime;
+  m_controllerTolerance = options.controllerTolerance;
+  m_rampStep = Note( Note::Semibreve ).getDuration() /
+               options.tempoRampDivision;
+}
+
 // Get the absolute RG time of evt.  We don't convert time to a
 // delta here because if we didn't end up inserting the event,
 // the new reference time that we made would be wrong.
 // @author Tom Breton (Tehom)
 timeT MidiInserter::getAbsoluteTime( RealTime realtime ) {
   timeT time   = m_comp.getElapsedTimeForRealTime( realtime );
-  timeT retVal = ( time * m_timingDivision ) / crotchetDuration;
+  timeT retVal = toMidiTime( time );
 #ifdef MIDI_DEBUG
 #endif
 
   return retVal;
 }
 
+timeT MidiInserter::toMidiTime( timeT time ) const {
+  // Notes that started before the file are struck at its start.
+  if( time < m_startTime ) return 0;
+  return ( ( time - m_startTime ) * m_timingDivision ) /
+         crotchetDuration;
+}
+
+// Start writing the tempo ramp that starts at time as steps.
+void MidiInserter::startTempoRamp( timeT time ) {
+  int n = m_comp.getTempoChangeNumberAt( time );
+  if( n < 0 ) return;
+
+  m_rampEnd = ( n + 1 < m_comp.getTempoChangeCount() )
+                  ? m_comp.getTempoChange( n + 1 ).first
+                  : m_comp.getEndMarker();
+  m_rampEnd      = std::min( m_rampEnd, m_comp.getEndMarker() );
+  m_rampStepTime = time;
+  m_rampTempo    = 0;
+  m_ramping      = m_rampStepTime < m_rampEnd;
+}
+
+// Write the steps of the current tempo ramp that start no later
+// than time.  Each step's tempo is the one that takes exactly as
+// long over the step as the ramp does, so events at the step
+// boundaries are at their exact real times and those in between
+// are off by a fraction of the tempo change over one step.
+void MidiInserter::writeTempoSteps( timeT time ) {
+  while( m_ramping && m_rampStepTime <= time ) {
+    timeT start = m_rampStepTime;
+    timeT end   = std::min(
+        start + std::max( m_rampStep, timeT( 1 ) ), m_rampEnd );
+    m_rampStepTime = end;
+    m_ramping      = end < m_rampEnd;
+
+    // We undo the scaling toMidiTime() does, so that the tempo
+    // fits the ticks the step has in the file.
+    timeT ticks = toMidiTime( end ) - toMidiTime( start );
+    if( ticks <= 0 ) continue;
+    timeT duration = ticks * crotchetDuration / m_timingDivision;
+    RealTime realDuration = m_comp.getElapsedRealTime( end ) -
+                            m_comp.getElapsedRealTime( start );
+    tempoT tempo = Composition::timeRatioToTempo(
+        realDuration, duration, -1 );
+
+    if( tempo == m_rampTempo ) continue;
+    m_conductorTrack.insertTempo( toMidiTime( start ), tempo );
+    m_rampTempo = tempo;
+  }
+}
+
 // Initialize a normal track (not a conductor track)
 // @author Tom Breton (Tehom)
 // Adapted from MidiFile.cpp
@@ -135,6 +241,61 @@ MidiInserter::TrackData &MidiInserter::getTrackData(
   return m_trackPosMap[key];
 }
 
+// Whether evt only repeats what its channel was last sent.  If
+// not, the channel state is updated for it.
+bool MidiInserter::isRedundant( const MappedEvent &evt ) {
+  switch( evt.getType() ) {
+    case MappedEvent::MidiController:
+    case MappedEvent::MidiProgramChange:
+    case MappedEvent::MidiPitchBend: break;
+    case MappedEvent::MidiSystemMessage:
+      // Sysex may reset anything.
+      for( int c = 0; c < 16; ++c ) m_channelStates[c].forget();
+      return false;
+    default: return false;
+  }
+
+  ChannelState &state =
+      m_channelStates[evt.getRecordedChannel() & 0x0f];
+
+  if( evt.getType() == MappedEvent::MidiProgramChange ) {
+    int program = evt.getData1();
+    if( program == state.m_program && !state.m_bankPending )
+      return true;
+    state.m_program     = program;
+    state.m_bankPending = false;
+    return false;
+  }
+
+  if( evt.getType() == MappedEvent::MidiPitchBend ) {
+    int bend = ( evt.getData1() << 7 ) | evt.getData2();
+    if( bend == state.m_pitchBend ) return true;
+    state.m_pitchBend = bend;
+    return false;
+  }
+
+  MidiByte controller = evt.getData1() & 0x7f;
+  if( controller == MIDI_CONTROLLER_RESET ) {
+    state.forgetControllers();
+    return false;
+  }
+  // Data entry and parameter selection act on whatever parameter
+  // is selected, so they aren't states we can compare.
+  if( !isStateController( controller ) ) return false;
+
+  int value = evt.getData2();
+  if( value == state.m_controllers[controller] ) return true;
+  state.m_controllers[controller] = value;
+  // A new MSB leaves its LSB to the receiver, which may reset it,
+  // so the next LSB must go out even if it's the one we last sent.
+  if( controller < 0x20 ) state.m_controllers[controller + 0x20] = -1;
+  // A bank select only takes effect at the next program change.
+  if( controller == MIDI_CONTROLLER_BANK_MSB ||
+      controller == MIDI_CONTROLLER_BANK_LSB )
+    state.m_bankPending = true;
+  return false;
+}
+
 // Get ready to receive events.  Assumes nothing is written to
 // tracks yet.
 // @author Tom Breton (Tehom)
@@ -164,49 +325,206 @@ void MidiInserter::setup() {
 // @author Tom Breton (Tehom)
 void MidiInserter::finish() {
   if( m_finished ) { return; }
+  writeTempoSteps( m_comp.getElapsedTimeForRealTime( m_trueEnd ) );
   timeT endOfComp = getAbsoluteTime( m_trueEnd );
   m_conductorTrack.endTrack( endOfComp );
   for( TrackIterator i = m_trackPosMap.begin();
        i != m_trackPosMap.end(); ++i ) {
     i->second.endTrack( endOfComp );
   }
+  thinControllers();
   m_finished = true;
 }
 
+// Drop the controller and pitch bend events that move their
+// channel's value by no more than m_controllerTolerance.
+//
+// Receivers hold the last value until the next event, so the value
+// a dropped event would have set is compared with the value held,
+// not with a line thru its neighbours as Ramer-Douglas-Peucker
+// would.  That keeps every dropped value within the tolerance of
+// what is actually heard.  Ramps are thinned in the middle, but the
+// events where they stop, turn or level off are kept, so that each
+// one arrives at its exact value.
+void MidiInserter::thinControllers() {
+  if( m_controllerTolerance < 0 ) return;
+
+  std::vector<MidiFile::MidiTrack *> tracks;
+  tracks.push_back( &m_conductorTrack.m_midiTrack );
+  for( TrackIterator i = m_trackPosMap.begin();
+       i != m_trackPosMap.end(); ++i )
+    tracks.push_back( &i->second.m_midiTrack );
+
+  struct LaneEvent {
+    timeT      time;
+    MidiEvent *event;
+    // The index of the next event on the same lane, if any.
+    size_t next;
+  };
+  struct TimeCmp {
+    bool operator()( const LaneEvent &a,
+                     const LaneEvent &b ) const {
+      return a.time < b.time;
+    }
+  };
+
+  // A channel's state is shared by all the tracks that play on
+  // it, so each channel's events are taken in time order from
+  // all of them.  A sysex may reset every channel.
+  std::vector<LaneEvent> channels[16];
+  for( size_t t = 0; t < tracks.size(); ++t ) {
+    timeT time = 0;
+    for( size_t n = 0; n < tracks[t]->size(); ++n ) {
+      MidiEvent *event = ( *tracks[t] )[n];
+      time += event->getTime();
+      if( event->isMeta() ) continue;
+
+      LaneEvent laneEvent = { time, event, 0 };
+      if( event->getEventCode() == MIDI_SYSTEM_EXCLUSIVE ) {
+        for( int c = 0; c < 16; ++c )
+          channels[c].push_back( laneEvent );
+      } else if( event->getMessageType() == MIDI_CTRL_CHANGE ||
+                 event->getMessageType() == MIDI_PITCH_BEND ) {
+        channels[event->getChannelNumber()].push_back( laneEvent );
+      }
+    }
+  }
+
+  // Lanes 0-127 are the controllers, 128 is pitch bend.
+  const int pitchBendLane = 128;
+
+  std::vector<MidiEvent *> dropped;
+
+  for( int c = 0; c < 16; ++c ) {
+    std::vector<LaneEvent> &events = channels[c];
+    std::stable_sort( events.begin(), events.end(), TimeCmp() );
+
+    size_t nextInLane[pitchBendLane + 1];
+    for( int lane = 0; lane <= pitchBendLane; ++lane )
+      nextInLane[lane] = events.size();
+
+    std::vector<int> lanes( events.size(), -1 );
+    std::vector<int> values( events.size(), 0 );
+    for( size_t i = events.size(); i-- > 0; ) {
+      const MidiEvent *event = events[i].event;
+      if( event->getMessageType() == MIDI_PITCH_BEND ) {
+        lanes[i] = pitchBendLane;
+        values[i] =
+            ( event->getData2() << 7 ) | event->getData1();
+      } else if( event->getMessageType() == MIDI_CTRL_CHANGE ) {
+        lanes[i]  = event->getData1() & 0x7f;
+        values[i] = event->getData2();
+      } else {
+        continue;
+      }
+      events[i].next       = nextInLane[lanes[i]];
+      nextInLane[lanes[i]] = i;
+    }
+
+    // The value each lane holds, -1 if unknown.
+    int held[pitchBendLane + 1];
+    for( int lane = 0; lane <= pitchBendLane; ++lane )
+      held[lane] = -1;
+
+    for( size_t i = 0; i < events.size(); ++i ) {
+      int lane = lanes[i];
+      if( lane < 0 || lane == MIDI_CONTROLLER_RESET ) {
+        // Sysex or Reset All Controllers.
+        for( int l = 0; l <= pitchBendLane; ++l ) held[l] = -1;
+        continue;
+      }
+      // Bank numbers aren't values that can be near each other.
+      if( lane != pitchBendLane &&
+          ( !isStateController( lane ) ||
+            lane == MIDI_CONTROLLER_BANK_MSB ||
+            lane == MIDI_CONTROLLER_BANK_LSB ) )
+        continue;
+
+      // Pitch bend has 14 bits to the controllers' 7.
+      int tolerance = ( lane == pitchBendLane )
+                          ? m_controllerTolerance << 7
+                          : m_controllerTolerance;
+      int value = values[i];
+      bool keep;
+      if( held[lane] < 0 ) {
+        keep = true;
+      } else if( value == held[lane] ) {
+        keep = false;
+      } else if( std::abs( value - held[lane] ) > tolerance ) {
+        keep = true;
+      } else if( events[i].next == events.size() ) {
+        // The last value the lane settles on.
+        keep = true;
+      } else {
+        int next = values[events[i].next];
+        // Keep where the curve levels off or turns.
+        keep = ( next == value ) ||
+               ( ( value > held[lane] ) != ( next > value ) );
+      }
+
+      if( keep )
+        held[lane] = value;
+      else
+        dropped.push_back( events[i].event );
+    }
+  }
+
+  if( dropped.empty() ) return;
+  std::sort( dropped.begin(), dropped.end() );
+
+  // Take the dropped events out, passing their deltas on to the
+  // events that follow them.
+  for( size_t t = 0; t < tracks.size(); ++t ) {
+    MidiFile::MidiTrack &track = *tracks[t];
+    MidiFile::MidiTrack  kept;
+    kept.reserve( track.size() );
+    timeT carried = 0;
+    for( size_t n = 0; n < track.size(); ++n ) {
+      MidiEvent *event = track[n];
+      if( std::binary_search( dropped.begin(), dropped.end(),
+                              event ) ) {
+        carried += event->getTime();
+        delete event;
+        continue;
+      }
+      event->setTime( event->getTime() + carried );
+      carried = 0;
+      kept.push_back( event );
+    }
+    track.swap( kept );
+  }
+}
+
 // Insert a (MidiEvent) copy of evt.
 // @author Tom Breton (Tehom)
 // Adapted from MidiFile.cpp
 void MidiInserter::insertCopy( const MappedEvent &evt ) {
+  if( isRedundant( evt ) ) return;
+
   MidiByte   midiChannel = evt.getRecordedChannel();
   TrackData &trackData =
       getTrackData( evt.getTrackId(), midiChannel );
-  timeT midiEventAbsoluteTime =
-      getAbsoluteTime( evt.getEventTime() );
-
-  // If we are ramping, calculate a previous tempo that would get
-  // us to this event at this time and pre-insert it, unless this
-  // event's time is the same as last.
-  if( m_ramping &&
-      ( midiEventAbsoluteTime != m_previousTime ) ) {
-    RealTime diffReal = evt.getEventTime() - m_previousRealTime;
-    // We undo the scaling getAbsoluteTime does.
-    timeT diffTime = ( midiEventAbsoluteTime - m_previousTime ) *
-                     crotchetDuration / m_timingDivision;
-
-    tempoT bridgingTempo =
-        Composition::timeRatioToTempo( diffReal, diffTime, -1 );
-
-    trackData.insertTempo( m_previousTime, bridgingTempo );
-    m_previousRealTime = evt.getEventTime();
-    m_previousTime     = midiEventAbsoluteTime;
-  }
+  timeT time =
+      m_comp.getElapsedTimeForRealTime( evt.getEventTime() );
+  timeT midiEventAbsoluteTime = toMidiTime( time );
+
+  // Events come in time order, so the tempo ramp can be written
+  // up to here.
+  writeTempoSteps( time );
 #ifdef MIDI_DEBUG
 #endif
 
   try {
     switch( evt.getType() ) {
       case MappedEvent::Tempo: {
-        m_ramping = ( evt.getData1() > 0 ) ? true : false;
+        // Any ramp before this has run up to it.
+        m_ramping = false;
+        if( evt.getData1() > 0 ) {
+          // A ramp.  Its first step starts here.
+          startTempoRamp( time );
+          writeTempoSteps( time );
+          if( m_rampTempo != 0 ) break;
+        }
         // Yes, we fetch it from "instrument" because
         // that's what TempoSegmentMapper puts it in.
         tempoT tempo = evt.getInstrument();
@@ -399,16 +717,85 @@ void MidiInserter::insertCopy( const MappedEvent &evt ) {
 #endif
   }
 }
-void MidiInserter::assignToMidiFile( MidiFile &midifile ) {
+// Merge all the tracks into one.  Each track is already in time
+// order, so this is a k-way merge rather than a sort; events at the
+// same time keep the order of their tracks, conductor first.
+MidiFile::MidiTrack MidiInserter::mergeTracks() {
+  std::vector<const MidiFile::MidiTrack *> sources;
+  sources.push_back( &m_conductorTrack.m_midiTrack );
+  for( TrackIterator i = m_trackPosMap.begin();
+       i != m_trackPosMap.end(); ++i )
+    sources.push_back( &i->second.m_midiTrack );
+
+  // Next event of each source.  Times are held as deltas by now,
+  // so the heap holds the absolute time of each source's next.
+  std::vector<size_t> next( sources.size(), 0 );
+
+  typedef std::pair<timeT, size_t> Head;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head> >
+      heads;
+
+  size_t total = 0;
+  for( size_t s = 0; s < sources.size(); ++s ) {
+    total += sources[s]->size();
+    if( !sources[s]->empty() )
+      heads.push( Head( ( *sources[s] )[0]->getTime(), s ) );
+  }
+
+  TrackData merged;
+  merged.m_previousTime = 0;
+  merged.m_midiTrack.reserve( total );
+
+  while( !heads.empty() ) {
+    timeT  time = heads.top().first;
+    size_t s    = heads.top().second;
+    heads.pop();
+
+    const MidiFile::MidiTrack &source = *sources[s];
+    MidiEvent *event = source[next[s]];
+    if( ++next[s] < source.size() )
+      heads.push(
+          Head( time + source[next[s]]->getTime(), s ) );
+
+    // One end of track is written below, and the track names
+    // of the other tracks have nothing to name in a single
+    // track.
+    if( event->isMeta() &&
+        ( event->getMetaEventCode() == MIDI_END_OF_TRACK ||
+          ( s > 0 &&
+            event->getMetaEventCode() == MIDI_TRACK_NAME ) ) ) {
+      delete event;
+      continue;
+    }
+
+    event->setTime( time );
+    merged.insertMidiEvent( event );
+  }
+
+  merged.endTrack( getAbsoluteTime( m_trueEnd ) );
+  return merged.m_midiTrack;
+}
+
+void MidiInserter::assignToMidiFile(
+    MidiFile &midifile, MidiFile::FileFormatType format ) {
   finish();
 
   // midifile.clearMidiComposition();
 
   // We leave out fields that write doesn't look at.
   //
-  midifile.m_numberOfTracks = m_trackPosMap.size() + 1;
   midifile.m_timingDivision = m_timingDivision;
-  midifile.m_format = MidiFile::MIDI_SIMULTANEOUS_TRACK_FILE;
+  midifile.m_format         = format;
+
+  if( format == MidiFile::MIDI_SINGLE_TRACK_FILE ) {
+    midifile.m_numberOfTracks     = 1;
+    midifile.m_midiComposition[0] = mergeTracks();
+    m_conductorTrack.m_midiTrack.clear();
+    m_trackPosMap.clear();
+    return;
+  }
+
+  midifile.m_numberOfTracks = m_trackPosMap.size() + 1;
 
   midifile.m_midiComposition[0] = m_conductorTrack.m_midiTrack;
   unsigned int index            = 0;
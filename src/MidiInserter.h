@@ -49,21 +49,69 @@ class MidiInserter : public MappedInserterBase
         timeT     m_previousTime;
     };
 
+    // @class MidiInserter::ChannelState The state of a MIDI channel
+    // as the events inserted so far leave it, as far as we know it.
+    // The same channel in different tracks of a file is the same
+    // channel, so this is kept per channel, not per track.
+    struct ChannelState
+    {
+        ChannelState() { forget(); }
+        // Forget everything, eg after a sysex that may have reset it.
+        void forget();
+        void forgetControllers();
+
+        // -1 for unknown
+        int m_program;
+        int m_controllers[128];
+        int m_pitchBend;
+        // A bank select was sent that the next program change must
+        // follow up.
+        bool m_bankPending;
+    };
+
     typedef std::pair<TrackId, int> TrackKey;
     typedef std::map<TrackKey, TrackData> TrackMap;
     typedef TrackMap::iterator TrackIterator;
 
  public:
     MidiInserter(Composition &composition, int timingDivision, RealTime trueEnd);
+    // With the timing division, thinning and tempo ramp steps of
+    // options.  The layout options are for assignToMidiFile().
+    // Composition time startTime is written at the start of the
+    // file, and any events before it are moved up to it.
+    MidiInserter(Composition &composition,
+                 const MidiFile::ExportOptions &options,
+                 timeT startTime, RealTime trueEnd);
 
     void insertCopy(const MappedEvent &evt) override;
 
-    void assignToMidiFile(MidiFile &midifile);
+    // Thin out controllers and pitch bends that change their value
+    // by no more than tolerance, in controller steps.  -1, the
+    // default, keeps them all.
+    void setControllerTolerance(int tolerance)
+        { m_controllerTolerance = tolerance; }
+
+    // Write tempo ramps as a tempo change every step, in
+    // Composition time.  The default is every semiquaver.
+    void setTempoRampStep(timeT step) { m_rampStep = step; }
+
+    // Hand the tracks to midifile, laid out for format, which must
+    // be format 0 or 1.
+    void assignToMidiFile(MidiFile &midifile,
+                          MidiFile::FileFormatType format =
+                              MidiFile::MIDI_SIMULTANEOUS_TRACK_FILE);
         
  private:
 
     // Get the absolute time of evt
     timeT getAbsoluteTime(RealTime time);
+    // Convert a Composition time to MIDI ticks.
+    timeT toMidiTime(timeT time) const;
+
+    // Start writing the tempo ramp that starts at time.
+    void startTempoRamp(timeT time);
+    // Write the tempo ramp's steps up to time, in Composition time.
+    void writeTempoSteps(timeT time);
 
     // Initialize a normal track, ie not a conductor track.
     void initNormalTrack(TrackData &track, TrackId RGTrackPos);
@@ -72,6 +120,10 @@ class MidiInserter : public MappedInserterBase
     // position, including the track itself.
     TrackData &getTrackData(TrackId RGTrackPos, int channelNb);
 
+    // Whether evt would only set its channel to what it already is,
+    // recording its effect if not.
+    bool isRedundant(const MappedEvent &evt);
+
     // Get ready to receive events.  Assumes nothing is written to
     // tracks yet.
     void setup();
@@ -79,6 +131,14 @@ class MidiInserter : public MappedInserterBase
     // Done receiving events.  Tracks will be complete when this
     // returns.
     void finish();
+
+    // Merge the conductor track and all the others into one, by
+    // time, for format 0.  Tracks must be finished.
+    MidiFile::MidiTrack mergeTracks();
+
+    // Drop controller and pitch bend events within
+    // m_controllerTolerance of the value their channel holds.
+    void thinControllers();
  
     Composition   &m_comp;
     // From RG track pos -> MIDI TrackData, the opposite direction
@@ -88,13 +148,26 @@ class MidiInserter : public MappedInserterBase
     // The conductor track, which is not part of the mapping.
     TrackData      m_conductorTrack;
     int            m_timingDivision;   // pulses per quarter note
+    // The Composition time at the start of the file.
+    timeT          m_startTime;
     bool           m_finished;
     RealTime       m_trueEnd;
+    int            m_controllerTolerance;
+
+    // Channel setup is sent each time a segment starts playing on a
+    // channel, mostly repeating what the channel has already been
+    // sent.  We only write what changes it.
+    ChannelState   m_channelStates[16];
 
-    // To keep track of ramping.
-    RealTime       m_previousRealTime;
-    timeT          m_previousTime;
+    // The tempo ramp being written, in Composition time.  Each
+    // step is written to the conductor track once an event at or
+    // after its start comes in.
     bool           m_ramping;
+    timeT          m_rampStep;
+    timeT          m_rampStepTime;
+    timeT          m_rampEnd;
+    // The tempo last written for the ramp.
+    tempoT         m_rampTempo;
     
     /* Static constants */
 
@@ -60,7 +60,7 @@ namespace Rosegarden
   can be recovered; they can't.  The values are assigned on demand,
   and there's no guarantee that a given string will always map to
   the same value (on separate invocations of the program).  This
-  is why there's no PropertyName(int) constructor and no mechanism
+  is why there's no public PropertyName(int) constructor and no mechanism
   for storing PropertyNames in properties.  (Of course, you can 
   store the string representation of a PropertyName in a property;
   but that's slow.)
@@ -117,6 +117,15 @@ private:
     int m_value;
 
     static int intern(const std::string &s);
+
+    /// A name interned earlier, from its getValue().
+    /**
+     * For Event, which keeps the values of the names of its unparsed
+     * properties and must hand them back without interning again.
+     */
+    explicit PropertyName(int value, bool /* interned */) :
+        m_value(value) { }
+    friend class Event;
 };
 
 inline std::ostream& operator<<(std::ostream &out, const PropertyName &n) {
@@ -2325,6 +2325,12 @@ bool RoseXmlHandler::endElement( const QString &namespaceURI,
 
     comp.updateTriggerSegmentReferences();
 
+    // Linked segments were read in with a copy of every event each;
+    // let them share what they can.
+    for( SegmentLinkerMap::iterator i = m_segmentLinkers.begin();
+         i != m_segmentLinkers.end(); ++i )
+      i->second->shareEventStorage();
+
   } else if( lcName == "event" ) {
     if( m_currentSegment && m_currentEvent ) {
       m_currentSegment->insert( m_currentEvent );
@@ -30,6 +30,7 @@
 #include <cstdio>
 #include <iostream>
 #include <iterator>
+#include <mutex>
 #include <typeinfo>
 
 namespace Rosegarden {
@@ -41,6 +42,10 @@ using std::string;
 
 static int g_runtimeSegmentId = 0;
 
+// Guards the observer lists of all Segments.  Observers come and go
+// once per mapper, so one lock for all of them costs nothing.
+static std::mutex g_observerMutex;
+
 Segment::Segment( SegmentType segmentType, timeT startTime )
   : EventContainer(),
     m_composition( nullptr ),
@@ -1350,6 +1355,16 @@ void Segment::checkInsertAsClefKey( Event *e ) const {
   }
 }
 
+void Segment::addObserver( SegmentObserver *obs ) {
+  std::lock_guard<std::mutex> lock( g_observerMutex );
+  m_observers.push_back( obs );
+}
+
+void Segment::removeObserver( SegmentObserver *obs ) {
+  std::lock_guard<std::mutex> lock( g_observerMutex );
+  m_observers.remove( obs );
+}
+
 void Segment::notifyAdd( Event *e ) const {
   Profiler profiler( "Segment::notifyAdd()" );
   checkInsertAsClefKey( e );
@@ -58,6 +58,14 @@ class BasicCommand;
  * ??? The STL container classes are not intended to be derived from.
  *     They provide no virtual dtor.  EventContainer should instead
  *     have a std::multiset member object.
+ *
+ * Whatever holds the events must keep iterators valid across inserts
+ * and erases elsewhere in it, as a tree does: Segment and its helpers
+ * hold iterators while they edit, eg Segment::erase(from, to) erases
+ * one event at a time up to to.  A sorted vector or a B-tree with
+ * node-local arrays moves events on every insert and erase, so either
+ * would need all that code changing first.  Readers that want to scan
+ * flat arrays build an index instead, see Segment.
  */
 class ROSEGARDENPRIVATE_EXPORT EventContainer : public std::multiset<Event*, Event::EventCmp>
 {
@@ -82,6 +90,14 @@ class ROSEGARDENPRIVATE_EXPORT EventContainer : public std::multiset<Event*, Eve
  * a Segment, take a look at SegmentNotationHelper.  If you want to play a
  * Segment, try SegmentPerformanceHelper for duration calculations.
  *
+ * To look up the sounding times of many of its notes, or controller
+ * values at many times, build a SegmentSoundingIndex or a
+ * SegmentControllerIndex.  Each keeps flat, sorted arrays of just what
+ * its reader asks for and follows the Segment as a SegmentObserver.
+ * There is no columnar copy of the whole Segment: no reader needs all
+ * of its columns, and keeping unused ones up to date costs time for
+ * nothing.
+ *
  * The Segment owns the Events its items are pointing at.
  */
 class ROSEGARDENPRIVATE_EXPORT Segment : public EventContainer
@@ -710,8 +726,13 @@ public:
     // Get the segments in the current composition.
     static SegmentMultiSet& getCompositionSegments();
     
-    void  addObserver(SegmentObserver *obs) { m_observers.push_back(obs); }
-    void removeObserver(SegmentObserver *obs) { m_observers.remove(obs); }
+    /**
+     * Observers may be added and removed from several threads at once,
+     * as the readers of a frozen Composition do.  Notifying them is
+     * not locked: a frozen Segment doesn't change.
+     */
+    void  addObserver(SegmentObserver *obs);
+    void removeObserver(SegmentObserver *obs);
 
     // List of visible EventRulers attached to this segment
     //
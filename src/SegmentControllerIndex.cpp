@@ -0,0 +1,142 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8
+ * sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.  See
+   the file COPYING included with this distribution for more
+   information.
+*/
+
+#include "SegmentControllerIndex.h"
+
+#include "ControllerEventAdapter.h"
+#include "MidiTypes.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+namespace Rosegarden {
+
+namespace {
+
+struct EntryTimeCmp {
+  template<typename Entry>
+  bool operator()( const Entry &e, timeT t ) const {
+    return e.time < t;
+  }
+};
+
+} // namespace
+
+SegmentControllerIndex::SegmentControllerIndex( Segment &segment )
+  : m_segment( &segment ), m_valid( false ) {
+  m_segment->addObserver( this );
+}
+
+SegmentControllerIndex::~SegmentControllerIndex() {
+  if( m_segment ) m_segment->removeObserver( this );
+}
+
+void SegmentControllerIndex::segmentDeleted( const Segment * ) {
+  // Don't call removeObserver() here: the Segment is iterating
+  // over its observer list, which dies with it anyway.
+  m_segment = nullptr;
+  m_valid   = false;
+}
+
+bool SegmentControllerIndex::isIndexed(
+    const std::string &eventType ) {
+  return eventType == Controller::EventType ||
+         eventType == PitchBend::EventType;
+}
+
+void SegmentControllerIndex::eventAdded( const Segment *,
+                                         Event *e ) {
+  // Mappers add ornament events as they go, mostly in time order,
+  // so keep up with those rather than rebuild.
+  if( m_valid ) add( e );
+}
+
+void SegmentControllerIndex::add( Event *e ) const {
+  Lane *lane;
+  if( e->isa( Controller::EventType ) ) {
+    // As ControllerSearch::matches(), ignore unnumbered ones.
+    if( !e->has( Controller::NUMBER ) ) return;
+    lane = &m_controllers[e->get<Int>( Controller::NUMBER )];
+  } else if( e->isa( PitchBend::EventType ) ) {
+    lane = &m_pitchBends;
+  } else {
+    return;
+  }
+
+  long value = 0;
+  ControllerEventAdapter( e ).getValue( value );
+  Entry entry = { e->getAbsoluteTime(), e->getSubOrdering(),
+                  value };
+
+  // The Segment puts an event after any it compares equal to, so
+  // do the same.
+  Lane::iterator i = lane->end();
+  while( i != lane->begin() ) {
+    Lane::iterator prev = i - 1;
+    if( prev->time < entry.time ||
+        ( prev->time == entry.time &&
+          prev->subOrdering <= entry.subOrdering ) )
+      break;
+    i = prev;
+  }
+  lane->insert( i, entry );
+}
+
+void SegmentControllerIndex::rebuild() const {
+  Profiler profiler( "SegmentControllerIndex::rebuild", false );
+
+  m_controllers.clear();
+  m_pitchBends.clear();
+  m_valid = true;
+  if( !m_segment ) return;
+
+  for( Segment::iterator i = m_segment->begin();
+       i != m_segment->end(); ++i )
+    add( *i );
+}
+
+ControllerSearchValue::Maybe SegmentControllerIndex::search(
+    const std::string &eventType, int controllerId,
+    timeT noEarlierThan, timeT noLaterThan ) const {
+  typedef ControllerSearchValue::Maybe Maybe;
+
+  if( !m_valid ) rebuild();
+
+  const Lane *lane;
+  if( eventType == PitchBend::EventType ) {
+    lane = &m_pitchBends;
+  } else {
+    std::map<int, Lane>::const_iterator found =
+        m_controllers.find( controllerId );
+    if( found == m_controllers.end() )
+      return Maybe( false, ControllerSearchValue( 0, 0 ) );
+    lane = &found->second;
+  }
+
+  // The last entry before noLaterThan.
+  Lane::const_iterator i = std::lower_bound(
+      lane->begin(), lane->end(), noLaterThan, EntryTimeCmp() );
+  if( i == lane->begin() )
+    return Maybe( false, ControllerSearchValue( 0, 0 ) );
+  --i;
+
+  if( i->time <= noEarlierThan )
+    return Maybe( false, ControllerSearchValue( 0, 0 ) );
+  return Maybe( true, ControllerSearchValue( i->value, i->time ) );
+}
+
+} // namespace Rosegarden
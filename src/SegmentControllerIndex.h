@@ -0,0 +1,100 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_SEGMENT_CONTROLLER_INDEX_H
+#define RG_SEGMENT_CONTROLLER_INDEX_H
+
+#include "ControllerContext.h"
+#include "Segment.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Rosegarden
+{
+
+/// The controller and pitch bend values of a Segment, by time.
+/**
+ * ControllerSearch looks for the latest value of a controller by
+ * walking back thru the Segment from the search time, testing every
+ * event on the way, so on a Segment with dense automation every search
+ * costs as much as the events it passes.  A SegmentControllerIndex
+ * keeps the time and value of every controller event, one sorted lane
+ * per controller number, and one for pitch bends, so that a search is
+ * a binary search in the one lane.
+ *
+ * The index observes its Segment.  Events added while the index is
+ * built are added to their lane; any other change makes the index be
+ * rebuilt lazily on the next search.  As with all other
+ * SegmentObservers, changing the properties of an Event that is
+ * already in the Segment is not noticed; call invalidate().
+ */
+class SegmentControllerIndex : public SegmentObserver
+{
+public:
+    explicit SegmentControllerIndex(Segment &segment);
+    ~SegmentControllerIndex() override;
+
+    /// Discard the index; it is rebuilt on next search.
+    void invalidate() { m_valid = false; }
+    bool isValid() const { return m_valid; }
+
+    Segment *getSegment() const { return m_segment; }
+
+    /// Whether events of eventType are indexed.
+    static bool isIndexed(const std::string &eventType);
+
+    /// The latest value later than noEarlierThan and before noLaterThan.
+    /**
+     * Same result as ControllerSearch::searchSegment(): of events at
+     * the same time, the last in the Segment wins.  controllerId is
+     * ignored for pitch bends.  eventType must be indexed.
+     */
+    ControllerSearchValue::Maybe
+    search(const std::string &eventType, int controllerId,
+           timeT noEarlierThan, timeT noLaterThan) const;
+
+    // SegmentObserver overrides
+    void eventAdded(const Segment *, Event *e) override;
+    void eventRemoved(const Segment *, Event *) override { invalidate(); }
+    void allEventsChanged(const Segment *) override { invalidate(); }
+    void segmentDeleted(const Segment *) override;
+
+private:
+    SegmentControllerIndex(const SegmentControllerIndex &);
+    SegmentControllerIndex &operator=(const SegmentControllerIndex &);
+
+    struct Entry
+    {
+        timeT time;
+        short subOrdering;
+        long value;
+    };
+    typedef std::vector<Entry> Lane;
+
+    void add(Event *e) const;
+    void rebuild() const;
+
+    Segment *m_segment;
+
+    mutable bool m_valid;
+    mutable std::map<int, Lane> m_controllers;
+    mutable Lane m_pitchBends;
+};
+
+}
+
+#endif
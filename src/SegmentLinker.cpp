@@ -410,6 +410,38 @@ void SegmentLinker::refreshSegment( Segment *seg ) {
   if( tempClone ) { delete tempClone; }
 }
 
+void SegmentLinker::shareEventStorage() {
+  if( m_linkedSegmentParamsList.empty() ) return;
+  const Segment *ref =
+      m_linkedSegmentParamsList.front().m_linkedSegment;
+
+  LinkedSegmentParamsList::iterator itr;
+  for( itr = ++m_linkedSegmentParamsList.begin();
+       itr != m_linkedSegmentParamsList.end(); ++itr ) {
+    Segment *seg = itr->m_linkedSegment;
+    timeT    offset = seg->getStartTime() - ref->getStartTime();
+
+    // Pair up the events at the same relative times, in order.
+    Segment::const_iterator i = ref->begin();
+    Segment::iterator       j = seg->begin();
+    while( i != ref->end() && j != seg->end() ) {
+      timeT refTime = ( *i )->getAbsoluteTime() + offset;
+      timeT segTime = ( *j )->getAbsoluteTime();
+      if( refTime < segTime ) {
+        ++i;
+      } else if( segTime < refTime ) {
+        ++j;
+      } else {
+        if( ( *j )->getSubOrdering() == ( *i )->getSubOrdering() &&
+            ( *j )->getType() == ( *i )->getType() )
+          ( *j )->shareProperties( **i );
+        ++i;
+        ++j;
+      }
+    }
+  }
+}
+
 int SegmentLinker::getNumberOfTmpSegments() const {
   int count = 0;
 
@@ -48,6 +48,14 @@ public:
     ///re-read one segment from any of the others
     void refreshSegment(Segment *segment);
 
+    /**
+     * Let events of the linked segments that have the same properties
+     * share one copy of them (see Event::shareProperties()).  Copies
+     * made by the linker share already; this is for segments that
+     * were read in separately, e.g. from a file.
+     */
+    void shareEventStorage();
+
     //factory functions for dealing with linking/unlinking of segments
     static Segment* createLinkedSegment(Segment *s);
     static bool unlinkSegment(Segment *s);
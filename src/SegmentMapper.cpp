@@ -42,8 +42,10 @@ void SegmentMapper::initSpecial() {
 SegmentMapper::~SegmentMapper() {}
 
 std::shared_ptr<SegmentMapper>
-SegmentMapper::makeMapperForSegment( RosegardenDocument *doc,
-                                     Segment *segment ) {
+SegmentMapper::makeMapperForSegment(
+    RosegardenDocument *doc, Segment *segment,
+    std::shared_ptr<LinkedSegmentMappings> linkedMappings,
+    bool deferChannelAllocation ) {
   std::shared_ptr<SegmentMapper> mapper;
 
   if( segment == nullptr ) {
@@ -53,7 +55,8 @@ SegmentMapper::makeMapperForSegment( RosegardenDocument *doc,
   switch( segment->getType() ) {
     case Segment::Internal:
       mapper = std::shared_ptr<SegmentMapper>(
-          new InternalSegmentMapper( doc, segment ) );
+          new InternalSegmentMapper( doc, segment, linkedMappings,
+                                     deferChannelAllocation ) );
       break;
     case Segment::Audio:
       mapper = std::shared_ptr<SegmentMapper>(
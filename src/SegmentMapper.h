@@ -26,6 +26,8 @@
 namespace Rosegarden
 {
 
+class ChannelManager;
+class LinkedSegmentMappings;
 class Segment;
 class RosegardenDocument;
 
@@ -36,13 +38,25 @@ public:
     ~SegmentMapper() override;
 
     /// Create the appropriate mapper for the segment type.  Factory function.
-    static std::shared_ptr<SegmentMapper> makeMapperForSegment(RosegardenDocument *, Segment *);
+    /**
+     * Linked segments share their mappings thru linkedMappings, if set.
+     * If deferChannelAllocation, the mapper leaves getting a channel to
+     * ChannelManager::allocateChannelIntervals().
+     */
+    static std::shared_ptr<SegmentMapper> makeMapperForSegment(
+        RosegardenDocument *, Segment *,
+        std::shared_ptr<LinkedSegmentMappings> linkedMappings =
+            std::shared_ptr<LinkedSegmentMappings>(),
+        bool deferChannelAllocation = false);
 
     int getSegmentRepeatCount() override;
     TrackId getTrackID() const override;
 
     void initSpecial() override;
 
+    /// The ChannelManager the mapped events play thru, if any.
+    virtual ChannelManager *getChannelManager() { return nullptr; }
+
 protected:
     SegmentMapper(RosegardenDocument *, Segment *);
 
@@ -76,7 +76,7 @@ SegmentPerformanceHelper::getTiedNotes(iterator i)
 	if (valid) {
 	    return iteratorcontainer();
 	} else {
-	    (*i)->unset(TIED_BACKWARD);
+	    if (!isFrozen()) (*i)->unset(TIED_BACKWARD);
 	    return c;
 	}
     }
@@ -110,7 +110,7 @@ SegmentPerformanceHelper::getTiedNotes(iterator i)
     if (!valid) {
 	// Related to #1171463: If we can find no following
 	// TIED_BACKWARD event, then we remove this property
-	(*i)->unset(TIED_FORWARD);
+	if (!isFrozen()) (*i)->unset(TIED_FORWARD);
     }
 
     return c;
@@ -415,7 +415,9 @@ SegmentPerformanceHelper::getGraceNoteTimeAndDuration(bool /* host */, iterator
 	    (**j)->getNotationDuration() > hostNoteNotationDuration) {
 	    hostNoteNotationDuration = (**j)->getNotationDuration();
 	}
-	(**j)->set<Bool>(MAY_HAVE_GRACE_NOTES, true);
+	if (!(**j)->has(MAY_HAVE_GRACE_NOTES) && !isFrozen()) {
+	    (**j)->set<Bool>(MAY_HAVE_GRACE_NOTES, true);
+	}
     }
 
     timeT graceNoteTime = hostNoteEarliestTime;
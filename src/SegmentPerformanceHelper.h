@@ -113,6 +113,17 @@ public:
      * the function returns true.
      */
     bool getGraceNoteTimeAndDuration(bool host, iterator i, timeT &t, timeT &d);
+
+private:
+    /**
+     * True if the segment belongs to a frozen Composition, in which
+     * case the fix-ups above have already been made and we must not
+     * write to the events.
+     */
+    bool isFrozen() {
+        return segment().getComposition() &&
+            segment().getComposition()->isFrozen();
+    }
 };
 
 }
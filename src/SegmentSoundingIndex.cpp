@@ -0,0 +1,222 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8
+ * sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.  See
+   the file COPYING included with this distribution for more
+   information.
+*/
+
+#include "SegmentSoundingIndex.h"
+
+#include "BaseProperties.h"
+#include "NotationTypes.h"
+#include "Profiler.h"
+
+#include <map>
+#include <vector>
+
+namespace Rosegarden {
+
+using namespace BaseProperties;
+
+SegmentSoundingIndex::SegmentSoundingIndex( Segment &segment )
+  : m_segment( &segment ), m_valid( false ) {
+  m_segment->addObserver( this );
+}
+
+SegmentSoundingIndex::~SegmentSoundingIndex() {
+  if( m_segment ) m_segment->removeObserver( this );
+}
+
+void SegmentSoundingIndex::segmentDeleted( const Segment * ) {
+  // Don't call removeObserver() here: the Segment is iterating
+  // over its observer list, which dies with it anyway.
+  m_segment = nullptr;
+  m_valid   = false;
+}
+
+const SegmentSoundingIndex::Entry &SegmentSoundingIndex::lookup(
+    const Event *e ) const {
+  if( !m_valid ) rebuild();
+  return m_entries.at( e );
+}
+
+void SegmentSoundingIndex::resolveGraceNotes(
+    const std::vector<Event *> &graceNotes,
+    const std::vector<Event *> &hostNotes, const Event *next ) const {
+  // Same rules as SegmentPerformanceHelper::
+  // getGraceNoteTimeAndDuration(): the grace notes take a cut of
+  // the host notes' duration, and share it out by chord.  The
+  // helper's getGraceAndHostNotes() also collects the first note
+  // after the group; it counts here but gets no entry.
+  bool nextIsHost = next && next->getSubOrdering() >= 0;
+  bool nextIsGrace = false;
+  if( next && !nextIsHost ) next->get<Bool>( IS_GRACE_NOTE, nextIsGrace );
+
+  timeT hostNoteEarliestTime     = 0;
+  timeT hostNoteShortestDuration = 0;
+  timeT hostNoteNotationDuration = 0;
+
+  for( size_t j = 0; j <= hostNotes.size(); ++j ) {
+    if( j == hostNotes.size() && !nextIsHost ) break;
+    const Event *h = ( j < hostNotes.size() ) ? hostNotes[j] : next;
+    if( j == 0 || h->getAbsoluteTime() < hostNoteEarliestTime )
+      hostNoteEarliestTime = h->getAbsoluteTime();
+    if( j == 0 || h->getDuration() < hostNoteShortestDuration )
+      hostNoteShortestDuration = h->getDuration();
+    if( j == 0 ||
+        h->getNotationDuration() > hostNoteNotationDuration )
+      hostNoteNotationDuration = h->getNotationDuration();
+  }
+
+  timeT graceNoteDuration = hostNoteNotationDuration / 4;
+  if( graceNoteDuration > hostNoteShortestDuration / 2 )
+    graceNoteDuration = hostNoteShortestDuration / 2;
+
+  for( size_t j = 0; j < hostNotes.size(); ++j ) {
+    Entry &en = m_entries[hostNotes[j]];
+    en.time   = hostNotes[j]->getAbsoluteTime() + graceNoteDuration;
+    en.duration = hostNotes[j]->getDuration() - graceNoteDuration;
+    en.head     = hostNotes[j];
+    en.grace    = true;
+  }
+
+  // A grace note's index is the number of chords begun before it
+  // in the list, as the helper counts it.
+  int              count           = 0;
+  int              prevSubOrdering = 0;
+  std::vector<int> index( graceNotes.size() );
+  for( size_t j = 0; j < graceNotes.size(); ++j ) {
+    index[j] = count;
+    if( graceNotes[j]->getSubOrdering() != prevSubOrdering ) {
+      prevSubOrdering = graceNotes[j]->getSubOrdering();
+      ++count;
+    }
+  }
+  if( nextIsGrace && next->getSubOrdering() != prevSubOrdering )
+    ++count;
+  if( count == 0 ) count = 1; // should not happen
+
+  for( size_t j = 0; j < graceNotes.size(); ++j ) {
+    Entry &en   = m_entries[graceNotes[j]];
+    int    n    = ( index[j] == count ) ? 0 : index[j];
+    en.duration = graceNoteDuration / count;
+    en.time     = hostNoteEarliestTime + en.duration * n;
+    en.head     = graceNotes[j];
+    en.grace    = true;
+  }
+}
+
+void SegmentSoundingIndex::rebuild() const {
+  Profiler profiler( "SegmentSoundingIndex::rebuild", false );
+
+  m_entries.clear();
+  m_valid = true;
+  if( !m_segment ) return;
+
+  m_entries.reserve( m_segment->size() );
+
+  // The tie chains still open, by pitch: the head, the total to
+  // add the rest of the chain to, if any, and the notation time at
+  // which the next note of the chain must start.
+  struct OpenChain {
+    Event *head;
+    timeT *total;
+    timeT  end;
+  };
+  std::map<long, OpenChain> open;
+
+  std::vector<Event *> graceNotes, hostNotes;
+
+  Segment::iterator i = m_segment->begin();
+  while( i != m_segment->end() ) {
+    // Take the events sharing a notation time together, so that
+    // grace notes and their host notes are resolved in one go.
+    timeT             t = ( *i )->getNotationAbsoluteTime();
+    Segment::iterator runEnd = i;
+    graceNotes.clear();
+    hostNotes.clear();
+    for( ; runEnd != m_segment->end() &&
+           ( *runEnd )->getNotationAbsoluteTime() == t;
+         ++runEnd ) {
+      Event *e = *runEnd;
+      if( !e->isa( Note::EventType ) ) continue;
+      if( e->getSubOrdering() >= 0 ) {
+        hostNotes.push_back( e );
+      } else {
+        bool isGrace = false;
+        if( e->get<Bool>( IS_GRACE_NOTE, isGrace ) && isGrace )
+          graceNotes.push_back( e );
+      }
+    }
+    if( !graceNotes.empty() && !hostNotes.empty() ) {
+      const Event *next = nullptr;
+      if( runEnd != m_segment->end() &&
+          ( *runEnd )->isa( Note::EventType ) )
+        next = *runEnd;
+      resolveGraceNotes( graceNotes, hostNotes, next );
+    }
+
+    for( ; i != runEnd; ++i ) {
+      Event *e  = *i;
+      Entry &en = m_entries[e];
+
+      if( !en.grace ) {
+        en.time     = e->getAbsoluteTime();
+        en.duration = e->getDuration();
+        en.head     = e;
+      }
+
+      long pitch;
+      if( !e->isa( Note::EventType ) ||
+          !e->get<Int>( PITCH, pitch ) )
+        continue;
+
+      bool tiedBack = false, tiedForward = false;
+      e->get<Bool>( TIED_BACKWARD, tiedBack );
+      e->get<Bool>( TIED_FORWARD, tiedForward );
+
+      std::map<long, OpenChain>::iterator c = open.find( pitch );
+
+      if( tiedBack && c != open.end() &&
+          c->second.end == e->getNotationAbsoluteTime() ) {
+        // Continues a chain: the head sounds for us.  (Like the
+        // helper, a grace or host note in a chain is counted by the
+        // head but still sounds its grace timing too.)
+        en.head = c->second.head;
+        if( c->second.total ) *c->second.total += e->getDuration();
+        if( !en.grace ) en.duration = 0;
+        if( tiedForward )
+          c->second.end += e->getNotationDuration();
+        else
+          open.erase( c );
+        continue;
+      }
+
+      // A backward tie with nothing to tie to is ignored, as the
+      // helper does; the note may still start a chain of its own.
+      // The rest of a grace or host note's chain is silent.
+      if( tiedForward ) {
+        OpenChain chain = { e, en.grace ? nullptr : &en.duration,
+                            e->getNotationAbsoluteTime() +
+                                e->getNotationDuration() };
+        open[pitch]     = chain;
+      } else if( c != open.end() &&
+                 e->getNotationAbsoluteTime() >= c->second.end ) {
+        // The chain's next note would have had to be this one.
+        open.erase( c );
+      }
+    }
+  }
+}
+
+} // namespace Rosegarden
@@ -0,0 +1,107 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_SEGMENT_SOUNDING_INDEX_H
+#define RG_SEGMENT_SOUNDING_INDEX_H
+
+#include "Segment.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace Rosegarden
+{
+
+/// Sounding times and durations of all events in a Segment.
+/**
+ * SegmentPerformanceHelper::getSoundingDuration() resolves ties and
+ * grace notes by searching backwards and forwards from the note it
+ * is asked about, so asking it about every note of a long tied
+ * passage or an ornamented score is slow.  A SegmentSoundingIndex
+ * resolves all tie chains and grace note groups in one pass over
+ * the Segment, recording for each event the head of its tie chain
+ * and the values getSoundingAbsoluteTime() and getSoundingDuration()
+ * would return: the head of a chain gets the total duration of the
+ * chain, the other members zero; grace notes and their host notes
+ * share out the host notes' time as the helper does.
+ *
+ * For well-formed ties the results are the same as the helper's.
+ * One difference: the helper's backward search stops at any earlier
+ * note that ends before the tied note starts, whatever its pitch, and
+ * then sounds the tied note again on its own.  The index follows each
+ * pitch separately.  Unlike the helper, the index never fixes up the
+ * events' tie properties.
+ *
+ * The index observes its Segment and is rebuilt lazily on the first
+ * lookup after the Segment notifies a change.  As with all other
+ * SegmentObservers, changing the properties of an Event that is
+ * already in the Segment is not noticed; call invalidate().
+ */
+class SegmentSoundingIndex : public SegmentObserver
+{
+public:
+    explicit SegmentSoundingIndex(Segment &segment);
+    ~SegmentSoundingIndex() override;
+
+    /// Discard the index; it is rebuilt on next lookup.
+    void invalidate() { m_valid = false; }
+    bool isValid() const { return m_valid; }
+
+    Segment *getSegment() const { return m_segment; }
+
+    // Lookups.  e must be in the Segment.
+
+    timeT getSoundingAbsoluteTime(const Event *e) const
+        { return lookup(e).time; }
+    timeT getSoundingDuration(const Event *e) const
+        { return lookup(e).duration; }
+    /// The first note of e's tie chain, e itself if it is not tied.
+    Event *getTieChainHead(const Event *e) const
+        { return lookup(e).head; }
+
+    // SegmentObserver overrides
+    void eventAdded(const Segment *, Event *) override { invalidate(); }
+    void eventRemoved(const Segment *, Event *) override { invalidate(); }
+    void allEventsChanged(const Segment *) override { invalidate(); }
+    void segmentDeleted(const Segment *) override;
+
+private:
+    SegmentSoundingIndex(const SegmentSoundingIndex &);
+    SegmentSoundingIndex &operator=(const SegmentSoundingIndex &);
+
+    struct Entry
+    {
+        Entry() : time(0), duration(0), head(nullptr), grace(false) { }
+        timeT time;
+        timeT duration;
+        Event *head;
+        bool grace; // a grace note or a host note of grace notes
+    };
+
+    const Entry &lookup(const Event *e) const;
+    void rebuild() const;
+    void resolveGraceNotes(const std::vector<Event *> &graceNotes,
+                           const std::vector<Event *> &hostNotes,
+                           const Event *next) const;
+
+    Segment *m_segment;
+
+    mutable bool m_valid;
+    mutable std::unordered_map<const Event *, Entry> m_entries;
+};
+
+}
+
+#endif
@@ -63,6 +63,8 @@
 
 
 #include <algorithm>
+#include <limits>
+#include <set>
 #include <utility> // For std::pair.
 
 namespace Rosegarden {
@@ -405,10 +407,19 @@ void SequenceManager::setTempo( const tempoT tempo ) {
 }
 
 void SequenceManager::resetCompositionMapper() {
+  resetCompositionMapper( std::numeric_limits<timeT>::min(),
+                          std::numeric_limits<timeT>::max(),
+                          std::set<TrackId>() );
+}
+
+void SequenceManager::resetCompositionMapper(
+    timeT startTime, timeT endTime,
+    const std::set<TrackId> &tracks ) {
   RosegardenSequencer::getInstance()
       ->compositionAboutToBeDeleted();
 
-  m_compositionMapper.reset( new CompositionMapper( m_doc ) );
+  m_compositionMapper.reset( new CompositionMapper(
+      m_doc, startTime, endTime, tracks ) );
 
   resetMetronomeMapper();
   resetTempoSegmentMapper();
@@ -28,6 +28,7 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <set>
 
 namespace Rosegarden
 {
@@ -356,6 +357,12 @@ public:
 
     /// Reset everything.
     void resetCompositionMapper();
+    /// Reset everything, mapping only the Segments of an excerpt.
+    /**
+     * See CompositionMapper's filtering ctor.
+     */
+    void resetCompositionMapper(timeT startTime, timeT endTime,
+                                const std::set<TrackId> &tracks);
     /// Add each Segment from the Composition to the CompositionMapper.
     void populateCompositionMapper();
     /**
@@ -0,0 +1,64 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8
+ * sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.  See
+   the file COPYING included with this distribution for more
+   information.
+*/
+
+#include "SplitMidiInserter.h"
+
+#include "MidiInserter.h"
+
+namespace Rosegarden {
+
+SplitMidiInserter::SplitMidiInserter(
+    Composition &composition, const MidiFile::ExportOptions &options,
+    timeT startTime, RealTime trueEnd )
+  : m_comp( composition ),
+    m_options( options ),
+    m_startTime( startTime ),
+    m_trueEnd( trueEnd ) {}
+
+SplitMidiInserter::~SplitMidiInserter() {
+  for( Parts::iterator i = m_parts.begin(); i != m_parts.end();
+       ++i )
+    delete i->second;
+}
+
+void SplitMidiInserter::insertCopy( const MappedEvent &evt ) {
+  // Conductor events go to every part, including those to come.
+  if( TrackId( evt.getTrackId() ) == NO_TRACK ) {
+    m_conductorEvents.push_back( evt );
+    for( Parts::iterator i = m_parts.begin(); i != m_parts.end();
+         ++i )
+      i->second->insertCopy( evt );
+    return;
+  }
+
+  PartKey key( evt.getTrackId(), -1 );
+  if( m_options.split == MidiFile::ExportOptions::SplitByChannel )
+    key.second = evt.getRecordedChannel();
+
+  Parts::iterator part = m_parts.find( key );
+  if( part == m_parts.end() ) {
+    MidiInserter *inserter = new MidiInserter(
+        m_comp, m_options, m_startTime, m_trueEnd );
+    for( size_t i = 0; i < m_conductorEvents.size(); ++i )
+      inserter->insertCopy( m_conductorEvents[i] );
+    part = m_parts.insert( Parts::value_type( key, inserter ) )
+               .first;
+  }
+  part->second->insertCopy( evt );
+}
+
+} // namespace Rosegarden
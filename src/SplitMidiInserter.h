@@ -0,0 +1,81 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2018 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_SPLITMIDIINSERTER_H
+#define RG_SPLITMIDIINSERTER_H
+
+#include "MappedEvent.h"
+#include "MappedInserterBase.h"
+#include "MidiFile.h"
+#include "RealTime.h"
+#include "Track.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace Rosegarden
+{
+
+class Composition;
+class MidiInserter;
+
+/// Inserter that gives each track a MidiInserter of its own.
+/**
+ * For writing each track, or each track and channel, to a MIDI file of
+ * its own from one pass over the events.  See MidiFile::convertToMidi().
+ *
+ * A part gets its MidiInserter when its first event comes in.  The
+ * inserter is first given the conductor events (tempo, time signatures,
+ * etc.) seen so far, so every part has the whole conductor track.  Each
+ * inserter keeps its own idea of what its channels have been sent, so
+ * what one part sends a channel isn't left out of another that shares it.
+ */
+class SplitMidiInserter : public MappedInserterBase
+{
+public:
+    /// A track and channel, or a track and -1 when splitting by track.
+    typedef std::pair<TrackId, int> PartKey;
+    typedef std::map<PartKey, MidiInserter *> Parts;
+
+    /// The arguments are passed on to each part's MidiInserter.
+    SplitMidiInserter(Composition &composition,
+                      const MidiFile::ExportOptions &options,
+                      timeT startTime, RealTime trueEnd);
+    ~SplitMidiInserter() override;
+
+    void insertCopy(const MappedEvent &evt) override;
+
+    /// The parts that have had events, with their inserters.
+    const Parts &getParts() const { return m_parts; }
+
+private:
+    SplitMidiInserter(const SplitMidiInserter &);
+    SplitMidiInserter &operator=(const SplitMidiInserter &);
+
+    Composition &m_comp;
+    MidiFile::ExportOptions m_options;
+    timeT m_startTime;
+    RealTime m_trueEnd;
+
+    // Events for the conductor track, for parts yet to start.
+    std::vector<MappedEvent> m_conductorEvents;
+
+    Parts m_parts;
+};
+
+}
+
+#endif /* ifndef RG_SPLITMIDIINSERTER_H */
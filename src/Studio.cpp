@@ -100,6 +100,24 @@ void Studio::addDevice( const std::string &name, DeviceId id,
   }
 
   m_devices.push_back( d );
+  indexDevice( d );
+}
+
+void Studio::indexDevice( Device *d ) {
+  if( !d ) return;
+  m_deviceIndex.insert( std::make_pair( d->getId(), d ) );
+
+  InstrumentList list = d->getAllInstruments();
+  for( size_t i = 0; i < list.size(); ++i )
+    m_instrumentIndex.insert(
+        std::make_pair( list[i]->getId(), list[i] ) );
+}
+
+void Studio::rebuildIndexes() {
+  m_deviceIndex.clear();
+  m_instrumentIndex.clear();
+  for( size_t i = 0; i < m_devices.size(); ++i )
+    indexDevice( m_devices[i] );
 }
 
 void Studio::removeDevice( DeviceId id ) {
@@ -108,6 +126,8 @@ void Studio::removeDevice( DeviceId id ) {
     if( ( *it )->getId() == id ) {
       delete *it;
       m_devices.erase( it );
+      // Another device may have the same IDs.
+      rebuildIndexes();
       return;
     }
   }
@@ -201,18 +221,10 @@ InstrumentList Studio::getPresentationInstruments() const {
 }
 
 Instrument *Studio::getInstrumentById( InstrumentId id ) {
-  std::vector<Device *>::iterator it;
-  InstrumentList                  list;
-  InstrumentList::iterator        iit;
-
-  for( it = m_devices.begin(); it != m_devices.end(); ++it ) {
-    list = ( *it )->getAllInstruments();
-
-    for( iit = list.begin(); iit != list.end(); ++iit )
-      if( ( *iit )->getId() == id ) return ( *iit );
-  }
-
-  return nullptr;
+  std::unordered_map<InstrumentId, Instrument *>::const_iterator
+      found = m_instrumentIndex.find( id );
+  if( found == m_instrumentIndex.end() ) return nullptr;
+  return found->second;
 }
 
 // From a user selection (from a "Presentation" list) return
@@ -263,6 +275,10 @@ Instrument *Studio::getInstrumentFor( Track *track ) {
 BussList Studio::getBusses() { return m_busses; }
 
 Buss *Studio::getBussById( BussId id ) {
+  // Busses are numbered by position, so try there first.
+  if( id < m_busses.size() && m_busses[id]->getId() == id )
+    return m_busses[id];
+
   for( BussList::iterator i = m_busses.begin();
        i != m_busses.end(); ++i ) {
     if( ( *i )->getId() == id ) return *i;
@@ -377,6 +393,7 @@ void Studio::clear() {
     delete *it;
 
   m_devices.erase( m_devices.begin(), m_devices.end() );
+  rebuildIndexes();
 }
 
 std::string Studio::toXmlString() const {
@@ -441,22 +458,14 @@ std::string Studio::toXmlString(
 //
 const MidiMetronome *Studio::getMetronomeFromDevice(
     DeviceId id ) {
-  std::vector<Device *>::iterator it;
+  Device *device = getDevice( id );
 
-  for( it = m_devices.begin(); it != m_devices.end(); ++it ) {
-    MidiDevice *midiDevice = dynamic_cast<MidiDevice *>( *it );
-    if( midiDevice && midiDevice->getId() == id &&
-        midiDevice->getMetronome() ) {
-      return midiDevice->getMetronome();
-    }
+  MidiDevice *midiDevice = dynamic_cast<MidiDevice *>( device );
+  if( midiDevice ) return midiDevice->getMetronome();
 
-    SoftSynthDevice *ssDevice =
-        dynamic_cast<SoftSynthDevice *>( *it );
-    if( ssDevice && ssDevice->getId() == id &&
-        ssDevice->getMetronome() ) {
-      return ssDevice->getMetronome();
-    }
-  }
+  SoftSynthDevice *ssDevice =
+      dynamic_cast<SoftSynthDevice *>( device );
+  if( ssDevice ) return ssDevice->getMetronome();
 
   return nullptr;
 }
@@ -637,26 +646,10 @@ void Studio::clearRecordIns() {
 }
 
 Device *Studio::getDevice( DeviceId id ) const {
-  // RG_DEBUG << "Studio[" << this << "]::getDevice(" << id <<
-  // ")... ";
-
-  std::vector<Device *>::const_iterator it;
-
-  for( it = m_devices.begin(); it != m_devices.end(); ++it ) {
-    // possibly fix a following seg.fault :
-    if( !( *it ) ) { continue; }
-
-    // RG_DEBUG << (*it)->getId();
-
-    if( ( *it )->getId() == id ) {
-      // RG_DEBUG << "Found";
-      return ( *it );
-    }
-  }
-
-  // RG_DEBUG << "NOT found";
-
-  return nullptr;
+  std::unordered_map<DeviceId, Device *>::const_iterator found =
+      m_deviceIndex.find( id );
+  if( found == m_deviceIndex.end() ) return nullptr;
+  return found->second;
 }
 
 Device *Studio::getAudioDevice() {
@@ -680,32 +673,18 @@ Device *Studio::getSoftSynthDevice() {
 }
 
 std::string Studio::getSegmentName( InstrumentId id ) {
-  MidiDevice *                         midiDevice;
-  std::vector<Device *>::iterator      it;
-  Rosegarden::InstrumentList::iterator iit;
-  Rosegarden::InstrumentList           instList;
+  Instrument *instrument = getInstrumentById( id );
+  if( !instrument ) return std::string( "" );
 
-  for( it = m_devices.begin(); it != m_devices.end(); ++it ) {
-    midiDevice = dynamic_cast<MidiDevice *>( *it );
-
-    if( midiDevice ) {
-      instList = ( *it )->getAllInstruments();
+  MidiDevice *midiDevice =
+      dynamic_cast<MidiDevice *>( instrument->getDevice() );
+  if( !midiDevice ) return std::string( "" );
 
-      for( iit = instList.begin(); iit != instList.end();
-           ++iit ) {
-        if( ( *iit )->getId() == id ) {
-          if( ( *iit )->sendsProgramChange() ) {
-            return ( *iit )->getProgramName();
-          } else {
-            return midiDevice->getName() + " " +
-                   ( *iit )->getName();
-          }
-        }
-      }
-    }
+  if( instrument->sendsProgramChange() ) {
+    return instrument->getProgramName();
+  } else {
+    return midiDevice->getName() + " " + instrument->getName();
   }
-
-  return std::string( "" );
 }
 
 InstrumentId Studio::getAudioPreviewInstrument() {
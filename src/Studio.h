@@ -14,6 +14,7 @@
 */
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "XmlExportable.h"
@@ -143,7 +144,9 @@ public:
     //
     const MidiMetronome* getMetronomeFromDevice(DeviceId id);
 
-    // Return the device list
+    // Return the device list.  Add and remove devices with
+    // addDevice() and removeDevice(), not thru this, or the lookups
+    // by ID won't know.
     //
     DeviceList* getDevices() { return &m_devices; }
 
@@ -197,8 +200,17 @@ public:
     void setMetronomeDevice(DeviceId device) { m_metronomeDevice = device; }
 
 private:
+    // Add d and its instruments to the indexes below, unless their
+    // IDs are taken already.
+    void indexDevice(Device *d);
+    void rebuildIndexes();
 
     DeviceList        m_devices;
+    // The devices and instruments by ID, so that we needn't search
+    // every device's instrument list for each lookup.  As with
+    // searching in order, the first of any duplicate IDs wins.
+    std::unordered_map<DeviceId, Device *>         m_deviceIndex;
+    std::unordered_map<InstrumentId, Instrument *> m_instrumentIndex;
 
     BussList          m_busses;
     RecordInList      m_recordIns;
@@ -133,6 +133,14 @@ public:
             m_timeScale.isPerformable();
     }
 
+    bool isSquished() const { return m_timeScale.isSquished(); }
+    // The performance time of the triggered segment's start.
+    timeT getAnchorTime() const { return m_timeScale.toPerformance(0); }
+    const TimeIntervalVector &getIntervals() const { return m_intervals; }
+    int getPitchDiff() const { return m_pitchDiff; }
+    int getVelocityDiff() const { return m_velocityDiff; }
+    bool getRetune() const { return m_retune; }
+
     bool Expand(Segment *target, Queue& queue) const;
 
 private:
@@ -395,13 +403,16 @@ TriggerSegmentRec::makeExpansion(Event *trigger,
 // The segment containing the triggering event
 // @param controllerContext
 // A ControllerContextMap on `containing'.
+// @param cache
+// If not nullptr, where to look for and remember this expansion.
 // @author Tom Breton (Tehom)
 bool
 TriggerSegmentRec::
 ExpandInto(Segment *target,
            Segment::iterator iTrigger,
            Segment *containing,
-           ControllerContextParams *controllerContextParams) const
+           ControllerContextParams *controllerContextParams,
+           TriggerExpansionCache *cache) const
 {
     if (!getSegment() || getSegment()->empty()) {
         return false;
@@ -409,6 +420,98 @@ ExpandInto(Segment *target,
 
     const int maxDepth = 10;
 
+    if (cache) {
+        // The cached expansion is made without controller params, so
+        // that it can be reused; controllers are made absolute per
+        // occurrence instead.
+        const TriggerExpansionContext
+            context(maxDepth, this, iTrigger, containing, nullptr,
+                    LinearTimeScale::m_identity);
+        if (!context.isPerformable()) { return false; }
+
+        if (!context.isSquished()) {
+            const timeT anchor = context.getAnchorTime();
+
+            TriggerExpansionCache::Key key;
+            key.id = getId();
+            key.pitchDiff = context.getPitchDiff();
+            key.velocityDiff = context.getVelocityDiff();
+            key.retune = context.getRetune();
+            // Only the part of the intervals that the ornament's
+            // events can fall in matters, so clip them to it.
+            // Otherwise, with ...ADJUST_NONE the last interval runs to
+            // the end of the containing segment and no two triggers
+            // would share a key.
+            const timeT span =
+                getSegment()->getEndTime() - getSegment()->getStartTime();
+            const TriggerExpansionCache::TimeIntervalVector &intervals =
+                context.getIntervals();
+            for (size_t i = 0; i < intervals.size(); ++i) {
+                const timeT startT = intervals[i].first - anchor;
+                if (startT > span) { break; }
+                key.intervals.push_back
+                    (std::make_pair(startT,
+                                    std::min(intervals[i].second - anchor,
+                                             span + 1)));
+            }
+
+            std::pair<std::map<TriggerExpansionCache::Key,
+                               TriggerExpansionCache::Expansion>::iterator,
+                      bool> found =
+                cache->m_expansions.insert
+                (std::make_pair(key, TriggerExpansionCache::Expansion()));
+            TriggerExpansionCache::Expansion &expansion =
+                found.first->second;
+
+            if (found.second) {
+                // First time: expand it for real.  Nested ornaments
+                // are placed with their own time scales and clipped
+                // to times that don't all move with this trigger, so
+                // only a flat ornament can be translated.
+                expansion.translatable = true;
+                for (Segment::iterator i = getSegment()->begin();
+                     i != getSegment()->getEndMarker(); ++i) {
+                    if ((*i)->has(BaseProperties::TRIGGER_SEGMENT_ID)) {
+                        expansion.translatable = false;
+                        break;
+                    }
+                }
+                if (expansion.translatable) {
+                    Segment scratch;
+                    TriggerExpansionContext::Queue nested;
+                    context.Expand(&scratch, nested);
+                    expansion.items.reserve(scratch.size());
+                    for (Segment::iterator i = scratch.begin();
+                         i != scratch.end(); ++i) {
+                        TriggerExpansionCache::Item item;
+                        item.prototype = new Event(**i);
+                        item.time = (*i)->getAbsoluteTime() - anchor;
+                        item.duration = (*i)->getDuration();
+                        expansion.items.push_back(item);
+                    }
+                }
+            }
+
+            if (expansion.translatable) {
+                for (size_t i = 0; i < expansion.items.size(); ++i) {
+                    const TriggerExpansionCache::Item &item =
+                        expansion.items[i];
+                    Event *newEvent =
+                        new Event(*item.prototype, item.time + anchor,
+                                  item.duration);
+                    if (controllerContextParams &&
+                        (newEvent->isa(Controller::EventType) ||
+                         newEvent->isa(PitchBend::EventType))) {
+                        controllerContextParams->
+                            makeControlValueAbsolute(newEvent);
+                    }
+                    target->insert(newEvent);
+                }
+                return !expansion.items.empty();
+            }
+        }
+    }
+
     bool insertedSomething = false;
     TriggerExpansionContext::Queue queue;
     // Put the initial expansion context into the queue.
@@ -431,6 +534,31 @@ ExpandInto(Segment *target,
     return insertedSomething;
 }
 
+/*** TriggerExpansionCache definitions ***/
+
+bool
+TriggerExpansionCache::Key::operator<(const Key &k) const
+{
+    if (id != k.id) { return id < k.id; }
+    if (pitchDiff != k.pitchDiff) { return pitchDiff < k.pitchDiff; }
+    if (velocityDiff != k.velocityDiff)
+        { return velocityDiff < k.velocityDiff; }
+    if (retune != k.retune) { return retune < k.retune; }
+    return intervals < k.intervals;
+}
+
+void
+TriggerExpansionCache::clear()
+{
+    for (std::map<Key, Expansion>::iterator i = m_expansions.begin();
+         i != m_expansions.end(); ++i) {
+        for (size_t j = 0; j < i->second.items.size(); ++j) {
+            delete i->second.items[j].prototype;
+        }
+    }
+    m_expansions.clear();
+}
+
 /*** LinearTimeScale definitions ***/
 
 const LinearTimeScale
@@ -17,8 +17,11 @@
 #define RG_TRIGGER_SEGMENT_H
 
 #include "Segment.h"
+#include <map>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace Rosegarden
 {
@@ -28,6 +31,7 @@ typedef unsigned int TriggerSegmentId;
 class ControllerContextParams;
 class Event;
 class Segment;
+class TriggerExpansionCache;
 
 class TriggerSegmentRec
 {       
@@ -67,10 +71,13 @@ public:
     Segment* makeExpansion(Event *trigger,
                            Segment *containing,
                            Instrument *instrument) const;
+    // If cache is given, expansions are remembered there and reused
+    // for later triggers that would expand the same way.
     bool ExpandInto(Segment *target,
                     Segment::iterator iTrigger,
                     Segment *containing,
-                    ControllerContextParams *controllerContextParams) const;
+                    ControllerContextParams *controllerContextParams,
+                    TriggerExpansionCache *cache = nullptr) const;
     int getTranspose(const Event *trigger) const;
     int getVelocityDiff(const Event *trigger) const;
     
@@ -95,6 +102,70 @@ protected:
     SegmentRuntimeIdSet  m_references;
 };
   
+/// Remembers ornament expansions for TriggerSegmentRec::ExpandInto.
+/**
+ * Where an ornament fires many times with the same parameters, it
+ * need only be expanded once.  An expansion is stored with its times
+ * relative to the trigger, keyed on the trigger segment and
+ * everything else that shapes it: the pitch and velocity adjustment,
+ * the retune flag and the sounding intervals of the trigger, as far
+ * as the ornament reaches.  Later triggers with the same key get a
+ * translated copy.
+ *
+ * Only expansions that are played at their own speed and contain no
+ * nested ornaments can be translated exactly; others are still
+ * expanded each time.
+ *
+ * The cache does not notice changes to the trigger segments; clear()
+ * it before expanding again after any change to the Composition.
+ */
+class TriggerExpansionCache
+{
+public:
+    TriggerExpansionCache() { }
+    ~TriggerExpansionCache() { clear(); }
+
+    void clear();
+
+private:
+    TriggerExpansionCache(const TriggerExpansionCache &);
+    TriggerExpansionCache &operator=(const TriggerExpansionCache &);
+
+    friend class TriggerSegmentRec;
+
+    typedef std::vector<std::pair<timeT, timeT> > TimeIntervalVector;
+
+    struct Key
+    {
+        TriggerSegmentId id;
+        int pitchDiff;
+        int velocityDiff;
+        bool retune;
+        // Relative to the expansion's anchor time
+        TimeIntervalVector intervals;
+
+        bool operator<(const Key &k) const;
+    };
+
+    // An event of the expansion, time relative to the anchor time
+    struct Item
+    {
+        Event *prototype;
+        timeT time;
+        timeT duration;
+    };
+
+    struct Expansion
+    {
+        // False if the expansion can't be translated; then items is
+        // empty and ExpandInto does it the long way.
+        bool translatable;
+        std::vector<Item> items;
+    };
+
+    std::map<Key, Expansion> m_expansions;
+};
+
 struct TriggerSegmentCmp
 {
     bool operator()(const TriggerSegmentRec &r1, const TriggerSegmentRec &r2) const {
@@ -22,6 +22,7 @@
 
 #include "XmlStorableEvent.h"
 
+#include "BaseProperties.h"
 #include "Event.h"
 #include "NotationTypes.h"
 
@@ -29,6 +30,8 @@
 
 #include <QString>
 
+#include <set>
+
 namespace Rosegarden {
 
 namespace {
@@ -56,6 +59,36 @@ ROSEGARDENPRIVATE_EXPORT std::string qStrToStrLocal8(
     const QString &qstr ) {
   return std::string( qstr.toLocal8Bit().data() );
 }
+
+std::set<std::string> notationOnlyNames() {
+  using namespace BaseProperties;
+  std::set<std::string> names;
+  names.insert( ACCIDENTAL.getName() );
+  names.insert( NOTE_TYPE.getName() );
+  names.insert( NOTE_DOTS.getName() );
+  names.insert( TIE_IS_ABOVE.getName() );
+  names.insert( DISPLACED_X.getName() );
+  names.insert( DISPLACED_Y.getName() );
+  names.insert( INVISIBLE.getName() );
+  names.insert( HAS_GRACE_NOTES.getName() );
+  names.insert( MARK_COUNT.getName() );
+  return names;
+}
+
+// Properties that only notation reads.  These are stored unparsed
+// (Event::setUnparsed) so that a load that never looks at them
+// doesn't pay for parsing and storing them.
+bool isNotationOnly( const std::string &name ) {
+  // Filled once, on first use, which is thread-safe.
+  static const std::set<std::string> names = notationOnlyNames();
+  if( names.count( name ) ) return true;
+
+  // The marks themselves are "mark1" etc, see
+  // BaseProperties::getMarkPropertyName().
+  return name.size() > 4 && name.compare( 0, 4, "mark" ) == 0 &&
+         name.find_first_not_of( "0123456789", 4 ) ==
+             std::string::npos;
+}
 } // namespace
 
 XmlStorableEvent::XmlStorableEvent(
@@ -120,19 +153,28 @@ XmlStorableEvent::XmlStorableEvent(
       bool    isNumeric;
       int     numVal;
 
+      std::string name( qstrtostr( attrName ) );
+      bool        lazy = isNotationOnly( name );
+
       if( valLowerCase == "true" || valLowerCase == "false" ) {
-        set<Bool>( qstrtostr( attrName ),
-                   valLowerCase == "true" );
+        // A repeated name is set again, as it would be if eager.
+        if( !lazy ||
+            !setUnparsed( name, Bool, qstrtostr( valLowerCase ) ) )
+          set<Bool>( name, valLowerCase == "true" );
 
       } else {
         // Not a bool, check if integer val
         numVal = val.toInt( &isNumeric );
         if( isNumeric ) {
-          set<Int>( qstrtostr( attrName ), numVal );
+          if( !lazy ||
+              !setUnparsed( name, Int,
+                            PropertyDefn<Int>::unparse( numVal ) ) )
+            set<Int>( name, numVal );
         } else {
           // not an int either, default to string
-          set<String>( qstrtostr( attrName ),
-                       qstrtostr( attrVal ) );
+          if( !lazy ||
+              !setUnparsed( name, String, qstrtostr( attrVal ) ) )
+            set<String>( name, qstrtostr( attrVal ) );
         }
       }
     }
@@ -156,6 +198,10 @@ void XmlStorableEvent::setPropertyFromAttributes(
   QString name = attributes.value( "name" );
   if( name == "" ) { return; }
 
+  // Non-persistent properties live per-Event and are few; only
+  // persistent ones are worth keeping unparsed.
+  bool lazy = persistent && isNotationOnly( qstrtostr( name ) );
+
   for( int i = 0; i < attributes.length(); ++i ) {
     QString attrName( attributes.qName( i ) ),
         attrVal( attributes.value( i ) );
@@ -165,15 +211,22 @@ void XmlStorableEvent::setPropertyFromAttributes(
     } else if( have ) {
       continue;
     } else if( attrName == "bool" ) {
-      set<Bool>( qstrtostr( name ), attrVal.toLower() == "true",
-                 persistent );
+      bool b = attrVal.toLower() == "true";
+      if( !lazy || !setUnparsed( qstrtostr( name ), Bool,
+                                 PropertyDefn<Bool>::unparse( b ) ) )
+        set<Bool>( qstrtostr( name ), b, persistent );
       have = true;
     } else if( attrName == "int" ) {
-      set<Int>( qstrtostr( name ), attrVal.toInt(), persistent );
+      if( !lazy ||
+          !setUnparsed( qstrtostr( name ), Int,
+                        PropertyDefn<Int>::unparse( attrVal.toInt() ) ) )
+        set<Int>( qstrtostr( name ), attrVal.toInt(), persistent );
       have = true;
     } else if( attrName == "string" ) {
-      set<String>( qstrtostr( name ), qstrtostr( attrVal ),
-                   persistent );
+      if( !lazy || !setUnparsed( qstrtostr( name ), String,
+                                 qstrtostr( attrVal ) ) )
+        set<String>( qstrtostr( name ), qstrtostr( attrVal ),
+                     persistent );
       have = true;
     } else {
     }
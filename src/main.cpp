@@ -14,7 +14,9 @@
 #include "MidiFile.h"
 #include "RosegardenDocument.h"
 
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
@@ -26,11 +28,148 @@ void die( string const& msg ) {
   exit( 1 );
 }
 
+// Parse the number after the first n characters of opt.
+int parseNumber( string const& opt, size_t n, string const& what ) {
+  string number = opt.substr( n );
+  CHECK( !number.empty() &&
+             number.find_first_not_of( "0123456789" ) ==
+                 string::npos,
+         opt.substr( 0, n - 1 ) + " takes " + what );
+  return atoi( number.c_str() );
+}
+
+// Apply an option to options.  Returns false if arg isn't one.
+bool parseOption( string const&                        arg,
+                  Rosegarden::MidiFile::ExportOptions& options ) {
+  if( arg.compare( 0, 2, "--" ) != 0 ) return false;
+
+  if( arg == "--format0" )
+    options.singleTrack = true;
+  else if( arg == "--compact" )
+    options.compact = true;
+  else if( arg.compare( 0, 7, "--thin=" ) == 0 )
+    options.controllerTolerance =
+        parseNumber( arg, 7, "a number of controller steps" );
+  else if( arg.compare( 0, 12, "--ramp-step=" ) == 0 ) {
+    options.tempoRampDivision =
+        parseNumber( arg, 12, "a note division, eg 16" );
+    CHECK( options.tempoRampDivision > 0,
+           "--ramp-step takes a note division, eg 16" );
+  } else if( arg.compare( 0, 6, "--ppq=" ) == 0 ) {
+    options.timingDivision =
+        parseNumber( arg, 6, "a number of pulses per quarter" );
+    CHECK( options.timingDivision > 0 &&
+               options.timingDivision < 0x8000,
+           "--ppq must be from 1 to 32767" );
+  } else if( arg.compare( 0, 7, "--bars=" ) == 0 ||
+             arg.compare( 0, 9, "--tracks=" ) == 0 ) {
+    die( arg.substr( 0, arg.find( '=' ) ) +
+         " must come before in-file.rg" );
+  } else if( arg == "--split=track" )
+    options.split = Rosegarden::MidiFile::ExportOptions::SplitByTrack;
+  else if( arg == "--split=channel" )
+    options.split =
+        Rosegarden::MidiFile::ExportOptions::SplitByChannel;
+  else
+    die( "unknown option " + arg );
+  return true;
+}
+
+// What to export, in bars and track positions counted from 1 as
+// Rosegarden shows them.  0 bars for the whole composition.
+struct Excerpt {
+  Excerpt() : firstBar( 0 ), lastBar( 0 ) {}
+  int         firstBar;
+  int         lastBar;
+  vector<int> tracks;
+};
+
+// Apply a --bars or --tracks option to excerpt.  Returns false if
+// arg is neither.
+bool parseExcerptOption( string const& arg, Excerpt& excerpt ) {
+  if( arg.compare( 0, 7, "--bars=" ) == 0 ) {
+    string::size_type dash = arg.find( '-', 7 );
+    CHECK( dash != string::npos, "--bars takes a range, eg 3-10" );
+    excerpt.firstBar = parseNumber( arg.substr( 0, dash ), 7,
+                                    "a range of bars, eg 3-10" );
+    excerpt.lastBar  = parseNumber( arg, dash + 1,
+                                    "a range of bars, eg 3-10" );
+    CHECK( excerpt.firstBar > 0 &&
+               excerpt.firstBar <= excerpt.lastBar,
+           "--bars takes a range of bars from 1, eg 3-10" );
+    return true;
+  }
+  if( arg.compare( 0, 9, "--tracks=" ) == 0 ) {
+    string::size_type from = 9;
+    while( true ) {
+      string::size_type comma = arg.find( ',', from );
+      if( comma == string::npos ) comma = arg.length();
+      int track = parseNumber( arg.substr( 0, comma ), from,
+                               "track numbers, eg 1,3" );
+      CHECK( track > 0, "--tracks takes track numbers from 1" );
+      excerpt.tracks.push_back( track );
+      if( comma == arg.length() ) break;
+      from = comma + 1;
+    }
+    return true;
+  }
+  return false;
+}
+
 int main( int argc, char** argv ) {
-  CHECK( argc == 3, "Usage: rg2midi in-file.rg out-file.mid" );
+  string const usage =
+      "Usage: rg2midi [options] in-file.rg [options] out-file.mid "
+      "[[options] out-file.mid ...]\n"
+      "Options before in-file.rg apply to every output, those "
+      "before an output to it alone.  - as in-file.rg reads "
+      "standard input, as out-file.mid writes standard output.\n"
+      "  --format0          merge all tracks into one (format 0)\n"
+      "  --compact          write note-offs as velocity 0 note-ons\n"
+      "  --thin=N           drop controller changes of N or less\n"
+      "  --ramp-step=N      write tempo ramps in 1/N notes\n"
+      "  --ppq=N            pulses per quarter note, default 480\n"
+      "  --split=track      a file per track, out-file-trackN.mid\n"
+      "  --split=channel    a file per track and channel,\n"
+      "                     out-file-trackN-chC.mid\n"
+      "Before in-file.rg only:\n"
+      "  --bars=A-B         export bars A to B only\n"
+      "  --tracks=N,M,...   export tracks N, M, ... only";
+  CHECK( argc >= 3, usage );
+
+  // Options for every output.
+  Rosegarden::MidiFile::ExportOptions defaults;
+  Excerpt                             excerpt;
+  int                                 i = 1;
+  for( ; i < argc && ( parseExcerptOption( argv[i], excerpt ) ||
+                       parseOption( argv[i], defaults ) );
+       ++i ) {}
+  CHECK( i < argc, usage );
+  string rg = argv[i++];
 
-  string rg  = argv[1];
-  string mid = argv[2];
+  Rosegarden::MidiFile::ExportList exports;
+  Rosegarden::MidiFile::Export     output;
+  output.options = defaults;
+  bool                             pending  = false;
+  bool                             toStdout = false;
+  for( ; i < argc; ++i ) {
+    if( parseOption( argv[i], output.options ) ) {
+      pending = true;
+      continue;
+    }
+    output.filename = argv[i];
+    if( output.filename == "-" ) {
+      CHECK( !toStdout, "only one output can be -" );
+      CHECK( output.options.split ==
+                 Rosegarden::MidiFile::ExportOptions::NoSplit,
+             "--split needs an output file name, not -" );
+      toStdout = true;
+    }
+    exports.push_back( output );
+    output.options = defaults;
+    pending        = false;
+  }
+  CHECK( !exports.empty(), usage );
+  CHECK( !pending, "options after the last output file" );
 
   Rosegarden::RosegardenDocument doc(
       /*skipAutoload=*/true,
@@ -44,9 +183,27 @@ int main( int argc, char** argv ) {
                          /*enableLock=*/false );
   CHECK( ok, "opening " + rg );
 
+  Rosegarden::Composition& comp = doc.getComposition();
+
+  // Nothing below edits the composition.
+  comp.freeze();
+
+  Rosegarden::MidiFile::ExportRange range;
+  if( excerpt.firstBar > 0 ) {
+    range.startTime = comp.getBarStart( excerpt.firstBar - 1 );
+    range.endTime   = comp.getBarEnd( excerpt.lastBar - 1 );
+  }
+  for( size_t t = 0; t < excerpt.tracks.size(); ++t ) {
+    Rosegarden::Track* track =
+        comp.getTrackByPosition( excerpt.tracks[t] - 1 );
+    CHECK( track, "no track " + to_string( excerpt.tracks[t] ) );
+    range.tracks.insert( track->getId() );
+  }
+
+  // All outputs come from one mapping of the composition.
   Rosegarden::MidiFile midiFile;
-  ok = midiFile.convertToMidi( doc, mid );
-  CHECK( ok, "writing midi file " + mid );
+  ok = midiFile.convertToMidi( doc, exports, range );
+  CHECK( ok, "writing midi files" );
 
   return 0;
 }